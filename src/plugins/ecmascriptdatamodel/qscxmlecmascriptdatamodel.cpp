@@ -7,8 +7,10 @@
 #include <QtScxml/private/qscxmlexecutablecontent_p.h>
 #include <QtScxml/private/qscxmlstatemachine_p.h>
 #include <QtScxml/private/qscxmldatamodel_p.h>
+#include <QtScxml/qscxmlevent.h>
 
 #include <qjsengine.h>
+#include <qhash.h>
 #include <qjsondocument.h>
 #include <QtQml/private/qjsvalue_p.h>
 #include <QtQml/private/qv4scopedvalue_p.h>
@@ -27,6 +29,24 @@ typedef std::function<QVariant (bool *)> ToVariantEvaluator;
 typedef std::function<void (bool *)> ToVoidEvaluator;
 typedef std::function<bool (bool *, std::function<bool ()>)> ForeachEvaluator;
 
+class QScxmlEcmaScriptDataModelPrivate;
+
+// Gives scripts access to the current event, see QScxmlEcmaScriptDataModelPrivate::assignEvent().
+class QScxmlEcmaScriptEventAccessor: public QObject
+{
+    Q_OBJECT
+public:
+    QScxmlEcmaScriptEventAccessor(QScxmlEcmaScriptDataModelPrivate *dataModel, QObject *parent)
+        : QObject(parent)
+        , m_dataModel(dataModel)
+    {}
+
+    Q_INVOKABLE QJSValue event();
+
+private:
+    QScxmlEcmaScriptDataModelPrivate *m_dataModel;
+};
+
 class QScxmlEcmaScriptDataModelPrivate : public QScxmlDataModelPrivate
 {
     Q_DECLARE_PUBLIC(QScxmlEcmaScriptDataModel)
@@ -35,32 +55,88 @@ public:
         : jsEngine(nullptr)
     {}
 
-    QString evalStr(const QString &expr, const QString &context, bool *ok)
+    // Expressions are compiled into functions on their first evaluation. Later evaluations of
+    // the same evaluator only call the function. There is one cache for each kind of result, as
+    // the same expression is wrapped differently for each. Assignments have their own IDs.
+    enum ExpressionKind {
+        StringExpression,
+        BoolExpression,
+        ValueExpression,
+        AssignmentExpression,
+        ExpressionKindCount
+    };
+
+    QString evalStr(int id, const QString &expr, const QString &context, bool *ok)
     {
-        QString script = QStringLiteral("(%1).toString()").arg(expr);
-        QJSValue v = eval(script, context, ok);
+        QJSValue v = call(StringExpression, id, expr, context, ok);
         if (*ok)
             return v.toString();
         else
             return QString();
     }
 
-    bool evalBool(const QString &expr, const QString &context, bool *ok)
+    bool evalBool(int id, const QString &expr, const QString &context, bool *ok)
     {
-        QString script = QStringLiteral("(function(){return !!(%1); })()").arg(expr);
-        QJSValue v = eval(script, context, ok);
+        QJSValue v = call(BoolExpression, id, expr, context, ok);
         if (*ok)
             return v.toBool();
         else
             return false;
     }
 
-    QJSValue evalJSValue(const QString &expr, const QString &context, bool *ok)
+    QJSValue evalJSValue(ExpressionKind kind, int id, const QString &expr,
+                         const QString &context, bool *ok)
     {
-        assertEngine();
+        Q_ASSERT(kind == ValueExpression || kind == AssignmentExpression);
+        return call(kind, id, expr, context, ok);
+    }
+
+    QJSValue call(ExpressionKind kind, int id, const QString &expr, const QString &context,
+                  bool *ok)
+    {
+        Q_ASSERT(ok);
+
+        // The IDs are only meaningful within one table. A state machine keeps its table, but
+        // should it get another one, the functions compiled for the old one must not run.
+        const QScxmlTableData *tableData = m_stateMachine->tableData();
+        if (compiledFor != tableData) {
+            for (auto &functions : compiledFunctions)
+                functions.clear();
+            validForeachItems.clear();
+            compiledFor = tableData;
+        }
+
+        QJSValue &function = compiledFunctions[kind][id];
+        if (function.isUndefined()) {
+            QString script;
+            switch (kind) {
+            case StringExpression:
+                script = QStringLiteral("(function(){return (%1).toString(); })").arg(expr);
+                break;
+            case BoolExpression:
+                script = QStringLiteral("(function(){return !!(%1); })").arg(expr);
+                break;
+            case ValueExpression:
+            case AssignmentExpression:
+                script = QStringLiteral("(function(){'use strict'; return (\n%1\n); })").arg(expr);
+                break;
+            default:
+                Q_UNREACHABLE();
+            }
+            // A syntax error is kept as the "function", and reported on every evaluation.
+            function = assertEngine()->evaluate(QStringLiteral("'use strict'; ") + script,
+                                                QStringLiteral("<expr>"), 0);
+        }
+
+        if (!function.isCallable())
+            return checkResult(function, context, ok);
 
-        QString script = QStringLiteral("(function(){'use strict'; return (\n%1\n); })()").arg(expr);
-        return eval(script, context, ok);
+        // String expressions get the global object as "this", as if they were evaluated at the
+        // top level. In the other kinds, "this" is undefined, as in any strict function.
+        return checkResult(kind == StringExpression
+                                   ? function.callWithInstance(assertEngine()->globalObject())
+                                   : function.call(),
+                           context, ok);
     }
 
     QJSValue eval(const QString &script, const QString &context, bool *ok)
@@ -71,6 +147,11 @@ public:
         // TODO: copy QJSEngine::evaluate and handle the case of v4->catchException() "our way"
 
         QJSValue v = engine->evaluate(QStringLiteral("'use strict'; ") + script, QStringLiteral("<expr>"), 0);
+        return checkResult(v, context, ok);
+    }
+
+    QJSValue checkResult(const QJSValue &v, const QString &context, bool *ok)
+    {
         if (v.isError()) {
             *ok = false;
             submitError(QStringLiteral("error.execution"),
@@ -113,16 +194,57 @@ public:
                                   QStringLiteral("(function(id){return _x.inState(id);})")));
     }
 
+    // The _event variable is bound to an accessor the first time an event is assigned. The
+    // object it returns is only created when a script reads _event, once per event. For event
+    // data given as a string, which may be JSON, the data property parses it on first read.
     void assignEvent(const QScxmlEvent &event)
     {
         if (event.name().isEmpty())
             return;
 
+        currentEvent = event;
+        currentEventValue = QJSValue();
+        if (!eventAccessor)
+            bindEvent();
+    }
+
+    void bindEvent()
+    {
+        Q_Q(QScxmlEcmaScriptDataModel);
         QJSEngine *engine = assertEngine();
-        QJSValue _event = engine->newObject();
-        QJSValue dataValue = eventDataAsJSValue(event.data());
-        _event.setProperty(QStringLiteral("data"), dataValue.isUndefined() ? QJSValue(QJSValue::UndefinedValue)
-                                                                           : dataValue);
+        eventAccessor = new QScxmlEcmaScriptEventAccessor(this, q);
+        QJSValue bind = engine->evaluate(QStringLiteral(
+                "(function(global, accessor) {"
+                "    Object.defineProperty(global, '_event', {"
+                "        get: function() { return accessor.event(); },"
+                "        enumerable: true"
+                "    });"
+                "})"));
+        bind.call({ dataModel, engine->newQObject(eventAccessor) });
+    }
+
+    QJSValue eventValue()
+    {
+        if (currentEventValue.isUndefined())
+            currentEventValue = createEventValue(currentEvent);
+        return currentEventValue;
+    }
+
+    QJSValue createEventValue(const QScxmlEvent &event)
+    {
+        QJSEngine *engine = assertEngine();
+        QJSValue _event;
+        const QVariant eventData = event.data();
+        if (eventData.isValid() && !eventData.canConvert<QVariantMap>()
+                && eventData != QVariant(QMetaType(QMetaType::VoidStar), nullptr)) {
+            if (lazyDataEvent.isUndefined())
+                lazyDataEvent = engine->evaluate(QString::fromLatin1(lazyDataEventSource));
+            _event = lazyDataEvent.call({ eventData.toString() });
+        } else {
+            _event = engine->newObject();
+            _event.setProperty(QStringLiteral("data"), eventDataAsJSValue(eventData));
+        }
+
         _event.setProperty(QStringLiteral("invokeid"), event.invokeId().isEmpty() ? QJSValue(QJSValue::UndefinedValue)
                                                                                   : engine->toScriptValue(event.invokeId()));
         if (!event.originType().isEmpty())
@@ -137,7 +259,7 @@ public:
         if (event.isErrorEvent())
             _event.setProperty(QStringLiteral("errorMessage"), event.errorMessage());
 
-        setReadonlyProperty(&dataModel, QStringLiteral("_event"), _event);
+        return _event;
     }
 
     QJSValue eventDataAsJSValue(const QVariant &eventData)
@@ -201,9 +323,14 @@ public:
     { return dataModel.property(name); }
 
     bool setProperty(const QString &name, const QJSValue &value, const QString &context)
+    {
+        return checkSetProperty(setProperty(&dataModel, name, value), name, context);
+    }
+
+    bool checkSetProperty(int result, const QString &name, const QString &context)
     {
         QString msg;
-        switch (setProperty(&dataModel, name, value)) {
+        switch (result) {
         case SetPropertySucceeded:
             return true;
         case SetReadOnlyPropertyFailed:
@@ -228,9 +355,55 @@ public:
         QScxmlStateMachinePrivate::get(m_stateMachine)->submitError(type, msg, sendid);
     }
 
+    // The item name of a <foreach> is checked once, by declaring a variable with that name.
+    bool isValidForeachItem(int foreachId, const QString &item)
+    {
+        auto it = validForeachItems.find(foreachId);
+        if (it == validForeachItems.end()) {
+            const QString script = QStringLiteral("(function(){var %1 = 0})()").arg(item);
+            it = validForeachItems.insert(foreachId, !assertEngine()->evaluate(script).isError());
+        }
+        return it.value();
+    }
+
 public:
     QStringList initialDataNames;
 
+private:
+    // Creates an event object with a data property that holds the given string, or what it parses
+    // to if it is a JSON object or array, like eventDataAsJSValue() does. The string is only
+    // parsed when the property is read. Until then, assigning to it works as for a plain property.
+    static constexpr const char *lazyDataEventSource =
+            "(function(text) {"
+            "    var event = {};"
+            "    var define = function(value) {"
+            "        Object.defineProperty(event, 'data', {"
+            "            value: value, writable: true, enumerable: true, configurable: true"
+            "        });"
+            "    };"
+            "    Object.defineProperty(event, 'data', {"
+            "        get: function() {"
+            "            var data = text;"
+            "            try {"
+            "                var parsed = JSON.parse(text);"
+            "                if (parsed !== null && typeof parsed === 'object')"
+            "                    data = parsed;"
+            "            } catch (e) {}"
+            "            define(data);"
+            "            return data;"
+            "        },"
+            "        set: define,"
+            "        enumerable: true,"
+            "        configurable: true"
+            "    });"
+            "    return event;"
+            "})";
+
+    QScxmlEvent currentEvent;
+    QJSValue currentEventValue; // undefined until a script reads _event
+    QJSValue lazyDataEvent;
+    QScxmlEcmaScriptEventAccessor *eventAccessor = nullptr;
+
 private: // Uses private API
     static void setReadonlyProperty(QJSValue *object, const QString &name, const QJSValue &value)
     {
@@ -288,10 +461,19 @@ private: // Uses private API
             return SetPropertyFailedForAnotherReason;
         }
 
-        QV4::PropertyAttributes attrs = o->getOwnProperty(s->toPropertyKey());
+        QV4::ScopedValue v(scope, QJSValuePrivate::convertToReturnedValue(engine, value));
+        return setProperty(engine, o, s, v);
+    }
+
+    static SetPropertyResult setProperty(QV4::ExecutionEngine *engine, QV4::Object *o,
+                                         QV4::String *name, const QV4::Value &value)
+    {
+        if (engine->hasException)
+            return SetPropertyFailedForAnotherReason;
+
+        QV4::PropertyAttributes attrs = o->getOwnProperty(name->toPropertyKey());
         if (attrs.isWritable() || attrs.isEmpty()) {
-            QV4::ScopedValue v(scope, QJSValuePrivate::convertToReturnedValue(engine, value));
-            o->insertMember(s, v);
+            o->insertMember(name, value);
             if (engine->hasException) {
                 engine->catchException();
                 return SetPropertyFailedForAnotherReason;
@@ -303,11 +485,65 @@ private: // Uses private API
         }
     }
 
+public:
+    // Runs the body of a <foreach> for each element of the array. The names of the item and the
+    // index are turned into property keys once, and the elements are read from the array as
+    // they are needed. The length is taken at the start, so elements appended by the body are
+    // not visited.
+    void runForeach(const QJSValue &array, const QString &item, const QString &index,
+                    const QString &context, QScxmlDataModel::ForeachLoopBody *body, bool *ok)
+    {
+        QV4::ExecutionEngine *engine = QJSValuePrivate::engine(&dataModel);
+        Q_ASSERT(engine);
+        QV4::Scope scope(engine);
+        QV4::ScopedObject global(scope, QJSValuePrivate::asManagedType<QV4::Object>(&dataModel));
+        QV4::ScopedObject elements(scope, QJSValuePrivate::asManagedType<QV4::Object>(&array));
+        if (!global || !elements) {
+            *ok = false;
+            return;
+        }
+
+        const bool hasIndex = !index.isEmpty();
+        QV4::ScopedString itemName(scope, engine->newString(item));
+        QV4::ScopedString indexName(scope, hasIndex ? engine->newString(index) : nullptr);
+        QV4::ScopedValue element(scope);
+        QV4::ScopedValue position(scope);
+
+        const qint64 length = elements->getLength();
+        for (qint64 currentIndex = 0; currentIndex < length; ++currentIndex) {
+            element = elements->get(uint(currentIndex));
+            if (engine->hasException)
+                engine->catchException();
+            *ok = checkSetProperty(setProperty(engine, global, itemName, element), item, context);
+            if (!*ok)
+                return;
+            if (hasIndex) {
+                position = QV4::Value::fromInt32(int(currentIndex));
+                *ok = checkSetProperty(setProperty(engine, global, indexName, position), index,
+                                       context);
+                if (!*ok)
+                    return;
+            }
+            body->run(ok);
+            if (!*ok)
+                return;
+        }
+        *ok = true;
+    }
+
 private:
     QJSEngine *jsEngine;
     QJSValue dataModel;
+    const QScxmlTableData *compiledFor = nullptr;
+    QHash<int, QJSValue> compiledFunctions[ExpressionKindCount];
+    QHash<int, bool> validForeachItems;
 };
 
+QJSValue QScxmlEcmaScriptEventAccessor::event()
+{
+    return m_dataModel->eventValue();
+}
+
 /*
  * The QScxmlEcmaScriptDataModel class is the ECMAScript data model for
  * a Qt SCXML state machine.
@@ -358,7 +594,7 @@ QString QScxmlEcmaScriptDataModel::evaluateToString(QScxmlExecutableContent::Eva
     Q_D(QScxmlEcmaScriptDataModel);
     const EvaluatorInfo &info = d->m_stateMachine->tableData()->evaluatorInfo(id);
 
-    return d->evalStr(d->string(info.expr), d->string(info.context), ok);
+    return d->evalStr(id, d->string(info.expr), d->string(info.context), ok);
 }
 
 bool QScxmlEcmaScriptDataModel::evaluateToBool(QScxmlExecutableContent::EvaluatorId id,
@@ -367,7 +603,7 @@ bool QScxmlEcmaScriptDataModel::evaluateToBool(QScxmlExecutableContent::Evaluato
     Q_D(QScxmlEcmaScriptDataModel);
     const EvaluatorInfo &info = d->m_stateMachine->tableData()->evaluatorInfo(id);
 
-    return d->evalBool(d->string(info.expr), d->string(info.context), ok);
+    return d->evalBool(id, d->string(info.expr), d->string(info.context), ok);
 }
 
 QVariant QScxmlEcmaScriptDataModel::evaluateToVariant(QScxmlExecutableContent::EvaluatorId id,
@@ -376,7 +612,8 @@ QVariant QScxmlEcmaScriptDataModel::evaluateToVariant(QScxmlExecutableContent::E
     Q_D(QScxmlEcmaScriptDataModel);
     const EvaluatorInfo &info = d->m_stateMachine->tableData()->evaluatorInfo(id);
 
-    return d->evalJSValue(d->string(info.expr), d->string(info.context), ok).toVariant();
+    return d->evalJSValue(QScxmlEcmaScriptDataModelPrivate::ValueExpression, id,
+                          d->string(info.expr), d->string(info.context), ok).toVariant();
 }
 
 void QScxmlEcmaScriptDataModel::evaluateToVoid(QScxmlExecutableContent::EvaluatorId id,
@@ -399,7 +636,8 @@ void QScxmlEcmaScriptDataModel::evaluateAssignment(QScxmlExecutableContent::Eval
     QString dest = d->string(info.dest);
 
     if (hasScxmlProperty(dest)) {
-        QJSValue v = d->evalJSValue(d->string(info.expr), d->string(info.context), ok);
+        QJSValue v = d->evalJSValue(QScxmlEcmaScriptDataModelPrivate::AssignmentExpression, id,
+                                    d->string(info.expr), d->string(info.context), ok);
         if (*ok)
             *ok = d->setProperty(dest, v, d->string(info.context));
     } else {
@@ -439,35 +677,14 @@ void QScxmlEcmaScriptDataModel::evaluateForeach(QScxmlExecutableContent::Evaluat
     }
 
     QString item = d->string(info.item);
-
-    QJSEngine *engine = d->assertEngine();
-    if (engine->evaluate(QStringLiteral("(function(){var %1 = 0})()").arg(item)).isError()) {
+    if (!d->isValidForeachItem(id, item)) {
         d->submitError(QStringLiteral("error.execution"), QStringLiteral("invalid item '%1' in %2")
                       .arg(d->string(info.item), d->string(info.context)));
         *ok = false;
         return;
     }
 
-    const int length = jsArray.property(QStringLiteral("length")).toInt();
-    QString idx = d->string(info.index);
-    QString context = d->string(info.context);
-    const bool hasIndex = !idx.isEmpty();
-
-    for (int currentIndex = 0; currentIndex < length; ++currentIndex) {
-        QJSValue currentItem = jsArray.property(static_cast<quint32>(currentIndex));
-        *ok = d->setProperty(item, currentItem, context);
-        if (!*ok)
-            return;
-        if (hasIndex) {
-            *ok = d->setProperty(idx, currentIndex, context);
-            if (!*ok)
-                return;
-        }
-        body->run(ok);
-        if (!*ok)
-            return;
-    }
-    *ok = true;
+    d->runForeach(jsArray, item, d->string(info.index), d->string(info.context), body, ok);
 }
 
 void QScxmlEcmaScriptDataModel::setScxmlEvent(const QScxmlEvent &event)
@@ -501,3 +718,5 @@ bool QScxmlEcmaScriptDataModel::setScxmlProperty(const QString &name, const QVar
 }
 
 QT_END_NAMESPACE
+
+#include "qscxmlecmascriptdatamodel.moc"
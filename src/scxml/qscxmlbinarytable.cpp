@@ -0,0 +1,744 @@
+// Copyright (C) 2026 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only OR GPL-3.0-only
+
+#include "qscxmlbinarytable_p.h"
+#include "qscxmlexecutablecontent_p.h"
+#include "qscxmltabledata_p.h"
+
+#include <QtCore/qbitarray.h>
+#include <QtCore/qstringlist.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QScxmlExecutableContent;
+
+namespace QScxmlInternal {
+namespace BinaryTable {
+
+namespace {
+constexpr quint32 Alignment = 4;
+
+quint32 aligned(quint32 size)
+{
+    return (size + Alignment - 1) & ~(Alignment - 1);
+}
+
+class Writer
+{
+public:
+    Writer()
+    {
+        std::memset(&m_header, 0, sizeof(Header));
+        std::memcpy(m_header.magic, Magic, sizeof(Magic));
+        m_header.byteOrderMark = ByteOrderMark;
+        m_header.formatVersion = FormatVersion;
+        m_header.outputRevision = Q_QSCXMLC_OUTPUT_REVISION;
+        m_data.resize(sizeof(Header));
+    }
+
+    Header &header() { return m_header; }
+
+    void addSection(Section section, const void *data, qsizetype count, qsizetype elementSize)
+    {
+        m_data.resize(aligned(quint32(m_data.size())));
+        m_header.sections[section] = { quint32(m_data.size()), quint32(count) };
+        if (count > 0)
+            m_data.append(static_cast<const char *>(data), count * elementSize);
+    }
+
+    void addSection(Section section, const QList<qint32> &data)
+    {
+        addSection(section, data.constData(), data.size(), sizeof(qint32));
+    }
+
+    quint32 addContent(const QByteArray &content)
+    {
+        m_data.resize(aligned(quint32(m_data.size())));
+        const quint32 offset = quint32(m_data.size());
+        m_data.append(content);
+        return offset;
+    }
+
+    QByteArray finish()
+    {
+        m_header.size = quint32(m_data.size());
+        std::memcpy(m_data.data(), &m_header, sizeof(Header));
+        return m_data;
+    }
+
+private:
+    QByteArray m_data;
+    Header m_header;
+};
+
+struct FactoryInfo
+{
+    InvokeInfo invokeInfo;
+    QList<StringId> namelist;
+    QList<ParameterInfo> params;
+    QSharedPointer<DocumentModel::ScxmlDocument> content;
+};
+} // anonymous namespace
+
+bool hasMagic(QByteArrayView data)
+{
+    return data.size() >= qsizetype(sizeof(Magic))
+            && std::memcmp(data.data(), Magic, sizeof(Magic)) == 0;
+}
+
+QByteArray write(DocumentModel::ScxmlDocument *doc, QString *errorMessage)
+{
+    Q_ASSERT(doc && doc->root);
+    Q_ASSERT(errorMessage);
+
+    if (doc->root->dataModel == DocumentModel::Scxml::CppDataModel) {
+        *errorMessage = QStringLiteral("A state machine with the C++ data model cannot be "
+                                       "written as a binary table.");
+        return QByteArray();
+    }
+
+    GeneratedTableData table;
+    GeneratedTableData::MetaDataInfo metaDataInfo;
+    GeneratedTableData::DataModelInfo dataModelInfo;
+    QList<FactoryInfo> factories;
+    auto factoryIdCreator = [&factories](
+            const InvokeInfo &invokeInfo, const QList<StringId> &namelist,
+            const QList<ParameterInfo> &params,
+            const QSharedPointer<DocumentModel::ScxmlDocument> &content) -> int {
+        factories.append({ invokeInfo, namelist, params, content });
+        return factories.size() - 1;
+    };
+    GeneratedTableData::build(doc, &table, &metaDataInfo, &dataModelInfo, factoryIdCreator);
+
+    Writer writer;
+    Header &header = writer.header();
+    header.dataModel = doc->root->dataModel;
+    header.name = table.theName;
+    header.initialSetup = table.theInitialSetup;
+
+    writer.addSection(StateMachineTableSection, table.theStateMachineTable);
+    writer.addSection(InstructionsSection, table.theInstructions);
+    writer.addSection(DataNamesSection, table.theDataNameIds);
+
+    QList<qint32> ints;
+    for (const EvaluatorInfo &info : std::as_const(table.theEvaluators))
+        ints << info.expr << info.context;
+    writer.addSection(EvaluatorsSection, ints.constData(), table.theEvaluators.size(),
+                      2 * sizeof(qint32));
+    ints.clear();
+    for (const AssignmentInfo &info : std::as_const(table.theAssignments))
+        ints << info.dest << info.expr << info.context;
+    writer.addSection(AssignmentsSection, ints.constData(), table.theAssignments.size(),
+                      3 * sizeof(qint32));
+    ints.clear();
+    for (const ForeachInfo &info : std::as_const(table.theForeaches))
+        ints << info.array << info.item << info.index << info.context;
+    writer.addSection(ForeachesSection, ints.constData(), table.theForeaches.size(),
+                      4 * sizeof(qint32));
+
+    QList<qint32> stringOffsets;
+    QString stringData;
+    for (const QString &string : std::as_const(table.theStrings)) {
+        stringOffsets.append(qint32(stringData.size()));
+        stringData.append(string);
+    }
+    stringOffsets.append(qint32(stringData.size()));
+    writer.addSection(StringOffsetsSection, stringOffsets);
+    writer.addSection(StringDataSection, stringData.constData(), stringData.size(),
+                      sizeof(char16_t));
+
+    QList<qint32> stateNames;
+    for (const QString &stateName : std::as_const(metaDataInfo.stateNames))
+        stateNames.append(qint32(table.theStrings.indexOf(stateName)));
+    writer.addSection(StateNamesSection, stateNames);
+
+    QList<FactoryRecord> records;
+    QList<qint32> factoryData;
+    QList<QByteArray> contents;
+    for (const FactoryInfo &factory : std::as_const(factories)) {
+        FactoryRecord record = {};
+        record.id = factory.invokeInfo.id;
+        record.prefix = factory.invokeInfo.prefix;
+        record.location = factory.invokeInfo.location;
+        record.context = factory.invokeInfo.context;
+        record.expr = factory.invokeInfo.expr;
+        record.finalize = factory.invokeInfo.finalize;
+        record.autoforward = factory.invokeInfo.autoforward ? 1 : 0;
+        record.namelistOffset = qint32(factoryData.size());
+        record.namelistCount = qint32(factory.namelist.size());
+        factoryData.append(factory.namelist);
+        record.paramsOffset = qint32(factoryData.size());
+        record.paramsCount = qint32(factory.params.size());
+        for (const ParameterInfo &param : factory.params)
+            factoryData << param.name << param.expr << param.location;
+        records.append(record);
+
+        QByteArray content;
+        if (factory.content) {
+            content = write(factory.content.data(), errorMessage);
+            if (content.isEmpty())
+                return QByteArray();
+        }
+        contents.append(content);
+    }
+    writer.addSection(FactoryDataSection, factoryData);
+
+    // The records are written last, so that the offsets of the nested blocks can be filled in.
+    for (qsizetype i = 0; i < records.size(); ++i) {
+        if (!contents.at(i).isEmpty()) {
+            records[i].contentOffset = writer.addContent(contents.at(i));
+            records[i].contentSize = quint32(contents.at(i).size());
+        }
+    }
+    writer.addSection(FactoriesSection, records.constData(), records.size(),
+                      sizeof(FactoryRecord));
+
+    return writer.finish();
+}
+
+namespace {
+// Nested instructions and nested blocks are checked, decoded and instantiated recursively.
+// Documents do not nest anywhere near this deep.
+constexpr int MaxNesting = 256;
+
+template <typename T>
+constexpr qint64 intsOf()
+{
+    return qint64(sizeof(T) / sizeof(qint32));
+}
+
+// Checks the instruction stream, and the IDs that the instructions, the state table and the
+// factories use to refer to strings, evaluators and containers.
+class ReferenceChecker
+{
+public:
+    ReferenceChecker(const qint32 *instructions, qint64 instructionCount)
+        : m_instructions(instructions)
+        , m_instructionCount(instructionCount)
+        , m_containers(qsizetype(instructionCount))
+    {}
+
+    qint64 stringCount = 0;
+    qint64 evaluatorCount = 0;
+    qint64 assignmentCount = 0;
+    qint64 foreachCount = 0;
+
+    bool string(qint32 id) const { return id == NoString || (id >= 0 && id < stringCount); }
+    bool evaluator(qint32 id) const
+    { return id == NoEvaluator || (id >= 0 && id < evaluatorCount); }
+    bool assignment(qint32 id) const { return id >= 0 && id < assignmentCount; }
+    bool foreachLoop(qint32 id) const { return id >= 0 && id < foreachCount; }
+
+    // Containers are the instructions at the top level of the stream.
+    bool container(qint32 id) const
+    {
+        return id == NoContainer
+                || (id >= 0 && id < m_instructionCount && m_containers.testBit(id));
+    }
+
+    bool params(const ParameterInfo *infos, qint64 count) const
+    {
+        return std::all_of(infos, infos + count, [this](const ParameterInfo &param) {
+            return string(param.name) && evaluator(param.expr) && string(param.location);
+        });
+    }
+
+    bool checkInstructions()
+    {
+        for (qint64 pos = 0; pos < m_instructionCount;) {
+            m_containers.setBit(qsizetype(pos));
+            pos = checkInstruction(pos, m_instructionCount, 0);
+            if (pos < 0)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    bool checkRange(qint64 first, qint64 last, int depth) const
+    {
+        while (first < last) {
+            first = checkInstruction(first, last, depth);
+            if (first < 0)
+                return false;
+        }
+        return true;
+    }
+
+    // Returns the position after the instruction at pos, or -1 if the instruction is invalid or
+    // does not end by end. The size of each part is checked before it is read.
+    qint64 checkInstruction(qint64 pos, qint64 end, int depth) const
+    {
+        if (depth > MaxNesting || pos >= end)
+            return -1;
+
+        const qint32 *ip = m_instructions + pos;
+        const qint64 available = end - pos;
+        switch (ip[0]) {
+        case Instruction::Sequence: {
+            if (available < intsOf<InstructionSequence>())
+                return -1;
+            const auto sequence = reinterpret_cast<const InstructionSequence *>(ip);
+            const qint64 size = intsOf<InstructionSequence>() + qint64(sequence->entryCount);
+            if (sequence->entryCount < 0 || available < size
+                    || !checkRange(pos + intsOf<InstructionSequence>(), pos + size, depth + 1)) {
+                return -1;
+            }
+            return pos + size;
+        }
+
+        case Instruction::Sequences: {
+            if (available < intsOf<InstructionSequences>())
+                return -1;
+            const auto sequences = reinterpret_cast<const InstructionSequences *>(ip);
+            const qint64 size = intsOf<InstructionSequences>() + qint64(sequences->entryCount);
+            if (sequences->sequenceCount < 0 || sequences->entryCount < 0 || available < size)
+                return -1;
+            qint64 next = pos + intsOf<InstructionSequences>();
+            for (qint32 i = 0; i < sequences->sequenceCount; ++i) {
+                if (next >= pos + size || m_instructions[next] != Instruction::Sequence)
+                    return -1;
+                next = checkInstruction(next, pos + size, depth + 1);
+                if (next < 0)
+                    return -1;
+            }
+            return next == pos + size ? next : -1;
+        }
+
+        case Instruction::Send: {
+            if (available < intsOf<Send>())
+                return -1;
+            const auto send = reinterpret_cast<const Send *>(ip);
+            const qint32 nameCount = send->namelist.count;
+            if (nameCount < 0 || available < intsOf<Send>() + nameCount + 1)
+                return -1;
+            const qint32 paramCount = send->params()->count;
+            const qint64 size = intsOf<Send>() + nameCount + 1 + 3 * qint64(paramCount);
+            if (paramCount < 0 || available < size
+                    || !string(send->instructionLocation) || !string(send->event)
+                    || !evaluator(send->eventexpr) || !string(send->type)
+                    || !evaluator(send->typeexpr) || !string(send->target)
+                    || !evaluator(send->targetexpr) || !string(send->id)
+                    || !string(send->idLocation) || !string(send->delay)
+                    || !evaluator(send->delayexpr) || !string(send->content)
+                    || !evaluator(send->contentexpr)
+                    || !params(send->params()->const_data(), paramCount)) {
+                return -1;
+            }
+            const StringId *names = send->namelist.const_data();
+            if (!std::all_of(names, names + nameCount, [this](StringId id) { return string(id); }))
+                return -1;
+            return pos + size;
+        }
+
+        case Instruction::Raise: {
+            if (available < intsOf<Raise>()
+                    || !string(reinterpret_cast<const Raise *>(ip)->event)) {
+                return -1;
+            }
+            return pos + intsOf<Raise>();
+        }
+
+        case Instruction::Log: {
+            if (available < intsOf<Log>())
+                return -1;
+            const auto log = reinterpret_cast<const Log *>(ip);
+            if (!string(log->label) || !evaluator(log->expr))
+                return -1;
+            return pos + intsOf<Log>();
+        }
+
+        case Instruction::JavaScript: {
+            if (available < intsOf<JavaScript>()
+                    || !evaluator(reinterpret_cast<const JavaScript *>(ip)->go)) {
+                return -1;
+            }
+            return pos + intsOf<JavaScript>();
+        }
+
+        case Instruction::Assign: {
+            if (available < intsOf<Assign>()
+                    || !assignment(reinterpret_cast<const Assign *>(ip)->expression)) {
+                return -1;
+            }
+            return pos + intsOf<Assign>();
+        }
+
+        case Instruction::Initialize: {
+            if (available < intsOf<Initialize>()
+                    || !assignment(reinterpret_cast<const Initialize *>(ip)->expression)) {
+                return -1;
+            }
+            return pos + intsOf<Initialize>();
+        }
+
+        case Instruction::If: {
+            // The conditions are followed by the blocks, as one InstructionSequences.
+            if (available < intsOf<If>())
+                return -1;
+            const auto _if = reinterpret_cast<const If *>(ip);
+            const qint32 conditionCount = _if->conditions.count;
+            const qint64 blocks = intsOf<If>() + qint64(conditionCount);
+            if (conditionCount < 0 || available <= blocks
+                    || ip[blocks] != Instruction::Sequences) {
+                return -1;
+            }
+            const EvaluatorId *conditions = _if->conditions.const_data();
+            if (!std::all_of(conditions, conditions + conditionCount,
+                             [this](EvaluatorId id) { return evaluator(id); })) {
+                return -1;
+            }
+            return checkInstruction(pos + blocks, end, depth + 1);
+        }
+
+        case Instruction::Foreach: {
+            // The body is the InstructionSequence at the end of the Foreach.
+            if (available < intsOf<Foreach>())
+                return -1;
+            const auto _foreach = reinterpret_cast<const Foreach *>(ip);
+            if (!foreachLoop(_foreach->doIt)
+                    || _foreach->block.instructionType != Instruction::Sequence) {
+                return -1;
+            }
+            return checkInstruction(pos + intsOf<Foreach>() - intsOf<InstructionSequence>(), end,
+                                    depth + 1);
+        }
+
+        case Instruction::Cancel: {
+            if (available < intsOf<Cancel>())
+                return -1;
+            const auto cancel = reinterpret_cast<const Cancel *>(ip);
+            if (!string(cancel->sendid) || !evaluator(cancel->sendidexpr))
+                return -1;
+            return pos + intsOf<Cancel>();
+        }
+
+        case Instruction::DoneData: {
+            if (available < intsOf<DoneData>())
+                return -1;
+            const auto doneData = reinterpret_cast<const DoneData *>(ip);
+            const qint32 paramCount = doneData->params.count;
+            const qint64 size = intsOf<DoneData>() + 3 * qint64(paramCount);
+            if (paramCount < 0 || available < size || !string(doneData->location)
+                    || !string(doneData->contents) || !evaluator(doneData->expr)
+                    || !params(doneData->params.const_data(), paramCount)) {
+                return -1;
+            }
+            return pos + size;
+        }
+
+        default:
+            return -1;
+        }
+    }
+
+    const qint32 *m_instructions;
+    qint64 m_instructionCount;
+    QBitArray m_containers;
+};
+
+// Checks that all offsets and counts of the state table are within bounds, that every index in
+// it refers to something that exists, and that the states form a tree.
+bool checkStateTable(const qint32 *table, qint64 tableSize, const ReferenceChecker &refs,
+                     qint32 factoryCount)
+{
+    const auto stateTable = reinterpret_cast<const StateTable *>(table);
+    if (tableSize < intsOf<StateTable>()
+            || stateTable->version != Q_QSCXMLC_OUTPUT_REVISION
+            || stateTable->stateCount < 0 || stateTable->transitionCount < 0
+            || stateTable->arraySize < 0
+            || stateTable->stateOffset < intsOf<StateTable>()
+            || stateTable->transitionOffset < stateTable->stateOffset
+                    + stateTable->stateCount * intsOf<StateTable::State>()
+            || stateTable->arrayOffset < stateTable->transitionOffset
+                    + stateTable->transitionCount * intsOf<StateTable::Transition>()
+            || stateTable->arrayOffset + qint64(stateTable->arraySize) >= tableSize
+            || table[stateTable->arrayOffset + stateTable->arraySize]
+                    != StateTable::terminator) {
+        return false;
+    }
+
+    const qint32 stateCount = stateTable->stateCount;
+    const qint32 transitionCount = stateTable->transitionCount;
+    const qint32 maxServiceId = stateTable->maxServiceId;
+    const auto state = [stateCount](qint32 index) {
+        return index >= 0 && index < stateCount;
+    };
+    const auto transition = [transitionCount](qint32 index) {
+        return index >= 0 && index < transitionCount;
+    };
+    const auto childOf = [stateTable, state](qint32 parent) {
+        return [stateTable, state, parent](qint32 index) {
+            return state(index) && stateTable->state(index).parent == parent;
+        };
+    };
+    const auto string = [&refs](qint32 id) { return refs.string(id); };
+    const auto serviceId = [maxServiceId](qint32 id) { return id >= 0 && id <= maxServiceId; };
+
+    // An array is a count, followed by that many elements.
+    const qint32 *arrays = table + stateTable->arrayOffset;
+    const auto validArray = [stateTable, arrays](qint32 index, const auto &validElement) {
+        if (index == StateTable::InvalidIndex)
+            return true;
+        if (index < 0 || index >= stateTable->arraySize || arrays[index] < 0
+                || index + 1 + qint64(arrays[index]) > stateTable->arraySize) {
+            return false;
+        }
+        return std::all_of(arrays + index + 1, arrays + index + 1 + arrays[index], validElement);
+    };
+
+    if (!refs.string(stateTable->name)
+            || (stateTable->dataModel != StateTable::NullDataModel
+                && stateTable->dataModel != StateTable::EcmaScriptDataModel)
+            || (stateTable->binding != StateTable::EarlyBinding
+                && stateTable->binding != StateTable::LateBinding)
+            || !transition(stateTable->initialTransition)
+            || !refs.container(stateTable->initialSetup)
+            || maxServiceId < StateTable::InvalidIndex || maxServiceId >= factoryCount
+            || !validArray(stateTable->childStates, childOf(StateTable::InvalidIndex))) {
+        return false;
+    }
+
+    for (qint32 i = 0; i < stateCount; ++i) {
+        const StateTable::State &s = stateTable->state(i);
+        if (!refs.string(s.name)
+                || (s.parent != StateTable::InvalidIndex && !state(s.parent))
+                || s.type < StateTable::State::Normal || s.type > StateTable::State::DeepHistory
+                || (s.initialTransition != StateTable::InvalidIndex
+                    && !transition(s.initialTransition))
+                || !refs.container(s.initInstructions) || !refs.container(s.entryInstructions)
+                || !refs.container(s.exitInstructions) || !refs.container(s.doneData)
+                || !validArray(s.childStates, childOf(i))
+                || !validArray(s.transitions, transition)
+                || !validArray(s.serviceFactoryIds, serviceId)) {
+            return false;
+        }
+    }
+
+    // Following the parents from any state has to end at the root.
+    enum : char { Unknown, OnPath, Rooted };
+    std::vector<char> rooted(size_t(stateCount), Unknown);
+    std::vector<qint32> path;
+    for (qint32 i = 0; i < stateCount; ++i) {
+        qint32 index = i;
+        for (; index != StateTable::InvalidIndex && rooted[size_t(index)] == Unknown;
+             index = stateTable->state(index).parent) {
+            rooted[size_t(index)] = OnPath;
+            path.push_back(index);
+        }
+        if (index != StateTable::InvalidIndex && rooted[size_t(index)] == OnPath)
+            return false;
+        for (qint32 onPath : path)
+            rooted[size_t(onPath)] = Rooted;
+        path.clear();
+    }
+
+    for (qint32 i = 0; i < transitionCount; ++i) {
+        const StateTable::Transition &t = stateTable->transition(i);
+        if (!validArray(t.events, string) || !refs.evaluator(t.condition)
+                || t.type < StateTable::Transition::Internal
+                || t.type > StateTable::Transition::Synthetic
+                || (t.source != StateTable::InvalidIndex && !state(t.source))
+                || !validArray(t.targets, state)
+                || !refs.container(t.transitionInstructions)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+} // anonymous namespace
+
+View::View(const uchar *data, qsizetype size)
+    : View(data, size, 0)
+{
+}
+
+View::View(const uchar *data, qsizetype size, int depth)
+    : m_data(data)
+    , m_header(reinterpret_cast<const Header *>(data))
+{
+    if (!validate(size, depth)) {
+        m_data = nullptr;
+        m_header = nullptr;
+    }
+}
+
+bool View::validate(qsizetype size, int depth) const
+{
+    if (!m_data || depth > MaxNesting || size < qsizetype(sizeof(Header))
+            || quintptr(m_data) % alignof(Header) != 0
+            || !hasMagic(QByteArrayView(m_data, size))
+            || m_header->byteOrderMark != ByteOrderMark
+            || m_header->formatVersion != FormatVersion
+            || m_header->outputRevision != Q_QSCXMLC_OUTPUT_REVISION
+            || m_header->size > quint64(size)) {
+        return false;
+    }
+
+    static const quint32 elementSizes[SectionCount] = {
+        sizeof(qint32), sizeof(qint32), 2 * sizeof(qint32), 3 * sizeof(qint32),
+        4 * sizeof(qint32), sizeof(qint32), sizeof(qint32), sizeof(char16_t), sizeof(qint32),
+        sizeof(FactoryRecord), sizeof(qint32)
+    };
+    for (int section = 0; section < SectionCount; ++section) {
+        const SectionInfo &info = m_header->sections[section];
+        if (info.offset % Alignment != 0 || info.offset < sizeof(Header)
+                || quint64(info.offset) + quint64(info.count) * elementSizes[section]
+                        > m_header->size) {
+            return false;
+        }
+    }
+
+    const quint32 stringCount = count(StringOffsetsSection);
+    if (stringCount == 0)
+        return false;
+    const qint32 *offsets = ints(StringOffsetsSection);
+    for (quint32 i = 0; i < stringCount; ++i) {
+        if (offsets[i] < (i ? offsets[i - 1] : 0) || quint32(offsets[i]) > count(StringDataSection))
+            return false;
+    }
+
+    ReferenceChecker refs(ints(InstructionsSection), count(InstructionsSection));
+    refs.stringCount = stringCount - 1;
+    refs.evaluatorCount = count(EvaluatorsSection);
+    refs.assignmentCount = count(AssignmentsSection);
+    refs.foreachCount = count(ForeachesSection);
+    if (!refs.checkInstructions()
+            || (m_header->dataModel != DocumentModel::Scxml::NullDataModel
+                && m_header->dataModel != DocumentModel::Scxml::JSDataModel)
+            || !refs.string(m_header->name) || !refs.container(m_header->initialSetup)
+            || !checkStateTable(stateMachineTable(), count(StateMachineTableSection), refs,
+                                factoryCount())) {
+        return false;
+    }
+
+    const auto allStrings = [&refs](const qint32 *ids, qint64 idCount) {
+        return std::all_of(ids, ids + idCount, [&refs](qint32 id) { return refs.string(id); });
+    };
+    if (!allStrings(ints(EvaluatorsSection), 2 * qint64(count(EvaluatorsSection)))
+            || !allStrings(ints(AssignmentsSection), 3 * qint64(count(AssignmentsSection)))
+            || !allStrings(ints(ForeachesSection), 4 * qint64(count(ForeachesSection)))
+            || !allStrings(ints(DataNamesSection), count(DataNamesSection))
+            || !allStrings(ints(StateNamesSection), count(StateNamesSection))) {
+        return false;
+    }
+
+    const quint32 factoryDataSize = count(FactoryDataSection);
+    const qint32 *factoryData = ints(FactoryDataSection);
+    for (int i = 0, ei = factoryCount(); i < ei; ++i) {
+        const FactoryRecord &record = factory(i);
+        if (record.namelistOffset < 0 || record.namelistCount < 0 || record.paramsOffset < 0
+                || record.paramsCount < 0
+                || quint64(record.namelistOffset) + quint64(record.namelistCount)
+                        > factoryDataSize
+                || quint64(record.paramsOffset) + 3 * quint64(record.paramsCount)
+                        > factoryDataSize) {
+            return false;
+        }
+        if (!refs.string(record.id) || !refs.string(record.prefix)
+                || !refs.string(record.location) || !refs.string(record.context)
+                || !refs.evaluator(record.expr) || !refs.container(record.finalize)
+                || !allStrings(factoryData + record.namelistOffset, record.namelistCount)
+                || !refs.params(reinterpret_cast<const ParameterInfo *>(
+                                    factoryData + record.paramsOffset), record.paramsCount)) {
+            return false;
+        }
+        if (record.contentOffset != 0
+                && (quint64(record.contentOffset) + record.contentSize > m_header->size
+                    || !View(m_data + record.contentOffset, record.contentSize, depth + 1)
+                            .isValid())) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+StringId *View::dataNames(int *count) const
+{
+    Q_ASSERT(count);
+    *count = int(this->count(DataNamesSection));
+    return const_cast<StringId *>(ints(DataNamesSection));
+}
+
+EvaluatorInfo View::evaluatorInfo(int id) const
+{
+    Q_ASSERT(id >= 0 && quint32(id) < count(EvaluatorsSection));
+    const qint32 *info = ints(EvaluatorsSection) + 2 * id;
+    return { info[0], info[1] };
+}
+
+AssignmentInfo View::assignmentInfo(int id) const
+{
+    Q_ASSERT(id >= 0 && quint32(id) < count(AssignmentsSection));
+    const qint32 *info = ints(AssignmentsSection) + 3 * id;
+    return { info[0], info[1], info[2] };
+}
+
+ForeachInfo View::foreachInfo(int id) const
+{
+    Q_ASSERT(id >= 0 && quint32(id) < count(ForeachesSection));
+    const qint32 *info = ints(ForeachesSection) + 4 * id;
+    return { info[0], info[1], info[2], info[3] };
+}
+
+QString View::string(StringId id) const
+{
+    if (id == NoString)
+        return QString();
+    Q_ASSERT(id >= 0 && quint32(id) + 1 < count(StringOffsetsSection));
+    const qint32 *offsets = ints(StringOffsetsSection);
+    const QChar *data = reinterpret_cast<const QChar *>(
+                m_data + m_header->sections[StringDataSection].offset);
+    return QString::fromRawData(data + offsets[id], offsets[id + 1] - offsets[id]);
+}
+
+QStringList View::stateNames() const
+{
+    QStringList names;
+    const qint32 *ids = ints(StateNamesSection);
+    for (quint32 i = 0, ei = count(StateNamesSection); i < ei; ++i)
+        names.append(string(ids[i]));
+    return names;
+}
+
+InvokeInfo View::invokeInfo(int index) const
+{
+    const FactoryRecord &record = factory(index);
+    return { record.id, record.prefix, record.location, record.context, record.expr,
+             record.finalize, record.autoforward != 0 };
+}
+
+QList<StringId> View::namelist(int index) const
+{
+    const FactoryRecord &record = factory(index);
+    const qint32 *data = ints(FactoryDataSection) + record.namelistOffset;
+    return QList<StringId>(data, data + record.namelistCount);
+}
+
+QList<ParameterInfo> View::params(int index) const
+{
+    const FactoryRecord &record = factory(index);
+    const qint32 *data = ints(FactoryDataSection) + record.paramsOffset;
+    QList<ParameterInfo> params;
+    params.reserve(record.paramsCount);
+    for (qint32 i = 0; i < record.paramsCount; ++i, data += 3)
+        params.append({ data[0], data[1], data[2] });
+    return params;
+}
+
+View View::content(int index) const
+{
+    const FactoryRecord &record = factory(index);
+    return record.contentOffset ? View(m_data + record.contentOffset, Validated()) : View();
+}
+
+} // BinaryTable namespace
+} // QScxmlInternal namespace
+
+QT_END_NAMESPACE
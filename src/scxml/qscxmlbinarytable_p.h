@@ -0,0 +1,167 @@
+// Copyright (C) 2026 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only OR GPL-3.0-only
+
+#ifndef QSCXMLBINARYTABLE_P_H
+#define QSCXMLBINARYTABLE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtScxml/private/qscxmlcompiler_p.h>
+#include <QtScxml/qscxmlexecutablecontent.h>
+#include <QtCore/qbytearray.h>
+#include <QtCore/qbytearrayview.h>
+#include <QtCore/qlist.h>
+#include <QtCore/qstring.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QScxmlInternal {
+
+// A binary table holds everything that a GeneratedTableData holds for a document, in one block
+// of memory that can be used in place, for example when mapped from a file. All references
+// within the block are offsets from its start, and all data is in native byte order. Invoked
+// documents given as inline <content> are stored as nested blocks.
+//
+// The block starts with a Header, followed by the sections it lists, each aligned to 4 bytes.
+// Strings are stored as UTF-16, so that they can be handed out without copying.
+namespace BinaryTable {
+
+enum : quint32 {
+    FormatVersion = 1,
+    ByteOrderMark = 0x01020304
+};
+
+constexpr char Magic[8] = { 'Q', 'S', 'C', 'X', 'M', 'L', 'T', 'B' };
+
+enum Section {
+    StateMachineTableSection, // qint32
+    InstructionsSection,      // qint32
+    EvaluatorsSection,        // 2 x qint32 per EvaluatorInfo
+    AssignmentsSection,       // 3 x qint32 per AssignmentInfo
+    ForeachesSection,         // 4 x qint32 per ForeachInfo
+    DataNamesSection,         // qint32
+    StringOffsetsSection,     // qint32, one more than there are strings
+    StringDataSection,        // char16_t
+    StateNamesSection,        // qint32, string IDs of the states that get a property
+    FactoriesSection,         // FactoryRecord
+    FactoryDataSection,       // qint32, name lists and parameters of the factories
+    SectionCount
+};
+
+struct SectionInfo {
+    quint32 offset; // in bytes, from the start of the block
+    quint32 count; // in units of the section's element type
+};
+
+struct Header {
+    char magic[8];
+    quint32 byteOrderMark;
+    quint32 formatVersion;
+    qint32 outputRevision;
+    quint32 size; // of the whole block, including nested blocks
+    qint32 dataModel; // DocumentModel::Scxml::DataModelType
+    qint32 name;
+    qint32 initialSetup;
+    SectionInfo sections[SectionCount];
+};
+
+struct FactoryRecord {
+    qint32 id;
+    qint32 prefix;
+    qint32 location;
+    qint32 context;
+    qint32 expr;
+    qint32 finalize;
+    qint32 autoforward;
+    qint32 namelistOffset; // into the factory data
+    qint32 namelistCount;
+    qint32 paramsOffset; // into the factory data, 3 x qint32 per ParameterInfo
+    qint32 paramsCount;
+    quint32 contentOffset; // of the nested block, from the start of this block, or 0
+    quint32 contentSize;
+};
+
+// Returns whether data starts like a binary table. It may still be invalid.
+bool hasMagic(QByteArrayView data);
+
+// Builds the tables for the document and serializes them. Returns an empty array and sets
+// errorMessage if the document cannot be represented, as happens for the C++ data model, whose
+// evaluators are compiled code.
+Q_SCXML_EXPORT QByteArray write(DocumentModel::ScxmlDocument *doc, QString *errorMessage);
+
+// Read access to a binary table that stays where it is. The memory has to outlive the view.
+class View
+{
+public:
+    View() = default;
+    View(const uchar *data, qsizetype size);
+
+    // Checks that the header is from a compatible writer, that all sections and nested blocks
+    // are within bounds, and that the state table, the instructions and everything they refer to
+    // by index are well-formed. None of the accessors may be used on an invalid view.
+    bool isValid() const { return m_header != nullptr; }
+
+    DocumentModel::Scxml::DataModelType dataModel() const
+    { return DocumentModel::Scxml::DataModelType(m_header->dataModel); }
+    QScxmlExecutableContent::StringId name() const { return m_header->name; }
+    QScxmlExecutableContent::ContainerId initialSetup() const { return m_header->initialSetup; }
+
+    const qint32 *stateMachineTable() const { return ints(StateMachineTableSection); }
+    QScxmlExecutableContent::InstructionId *instructions() const
+    { return const_cast<qint32 *>(ints(InstructionsSection)); }
+    QScxmlExecutableContent::StringId *dataNames(int *count) const;
+
+    QScxmlExecutableContent::EvaluatorInfo evaluatorInfo(int id) const;
+    QScxmlExecutableContent::AssignmentInfo assignmentInfo(int id) const;
+    QScxmlExecutableContent::ForeachInfo foreachInfo(int id) const;
+
+    QString string(QScxmlExecutableContent::StringId id) const;
+    QStringList stateNames() const;
+
+    int factoryCount() const { return int(count(FactoriesSection)); }
+    QScxmlExecutableContent::InvokeInfo invokeInfo(int factory) const;
+    QList<QScxmlExecutableContent::StringId> namelist(int factory) const;
+    QList<QScxmlExecutableContent::ParameterInfo> params(int factory) const;
+    View content(int factory) const; // invalid if the factory has no inline content
+
+private:
+    View(const uchar *data, qsizetype size, int depth);
+
+    // For a nested block that validate() has already checked as part of the enclosing view.
+    struct Validated {};
+    View(const uchar *data, Validated)
+        : m_data(data)
+        , m_header(reinterpret_cast<const Header *>(data))
+    {}
+
+    bool validate(qsizetype size, int depth) const;
+    quint32 count(Section section) const { return m_header->sections[section].count; }
+    const qint32 *ints(Section section) const
+    {
+        return reinterpret_cast<const qint32 *>(m_data + m_header->sections[section].offset);
+    }
+    const FactoryRecord &factory(int index) const
+    {
+        return reinterpret_cast<const FactoryRecord *>(
+                    m_data + m_header->sections[FactoriesSection].offset)[index];
+    }
+
+    const uchar *m_data = nullptr;
+    const Header *m_header = nullptr;
+};
+
+} // BinaryTable namespace
+} // QScxmlInternal namespace
+
+QT_END_NAMESPACE
+
+#endif // QSCXMLBINARYTABLE_P_H
@@ -17,12 +17,17 @@
 #include "qscxmlstatemachine.h"
 #include "qscxmltabledata_p.h"
 
+#include "qscxmlbinarytable_p.h"
+
+#include <QtCore/qcryptographichash.h>
+#include <QtCore/qmutex.h>
 #include <private/qmetaobjectbuilder_p.h>
 #endif // BUILD_QSCXMLC
 
 #include <QtCore/qmap.h>
 
 #include <functional>
+#include <memory>
 
 namespace {
 enum {
@@ -430,6 +435,8 @@ private:
 };
 
 #ifndef BUILD_QSCXMLC
+class DynamicStateMachineTable;
+
 class InvokeDynamicScxmlFactory: public QScxmlInvokableServiceFactory
 {
     Q_OBJECT
@@ -440,13 +447,13 @@ public:
         : QScxmlInvokableServiceFactory(invokeInfo, namelist, params)
     {}
 
-    void setContent(const QSharedPointer<DocumentModel::ScxmlDocument> &content)
+    void setContent(const QSharedPointer<DynamicStateMachineTable> &content)
     { m_content = content; }
 
     QScxmlInvokableService *invoke(QScxmlStateMachine *child) override;
 
 private:
-    QSharedPointer<DocumentModel::ScxmlDocument> m_content;
+    QSharedPointer<DynamicStateMachineTable> m_content;
 };
 
 class DynamicStateMachinePrivate : public QScxmlStateMachinePrivate
@@ -482,7 +489,108 @@ public:
     }
 };
 
-class DynamicStateMachine: public QScxmlStateMachine, public QScxmlInternal::GeneratedTableData
+// The parts of a state machine created at run time that do not change once they are built: the
+// tables, the descriptions of its service factories, and its meta object. They are shared by all
+// state machines created from the same document. The tables are either compiled from the
+// document, or used in place from a binary table.
+class DynamicStateMachineTable
+{
+    Q_DISABLE_COPY(DynamicStateMachineTable)
+
+public:
+    DynamicStateMachineTable() = default;
+
+    virtual ~DynamicStateMachineTable()
+    {
+        free(const_cast<QMetaObject *>(m_metaObject));
+    }
+
+    virtual QScxmlTableData *tableData() = 0;
+
+protected:
+    QScxmlInvokableServiceFactory *createServiceFactory(int id) const
+    {
+        // The state machine caches and owns the factories it gets, so create a new one each time.
+        const FactoryInfo &info = m_factories.at(id);
+        auto factory = new InvokeDynamicScxmlFactory(info.invokeInfo, info.namelist, info.params);
+        factory->setContent(info.content);
+        return factory;
+    }
+
+private:
+    friend class DynamicStateMachine;
+
+    struct FactoryInfo
+    {
+        QScxmlExecutableContent::InvokeInfo invokeInfo;
+        QList<QScxmlExecutableContent::StringId> namelist;
+        QList<QScxmlExecutableContent::ParameterInfo> params;
+        QSharedPointer<DynamicStateMachineTable> content; // compiled inline <content>, if any
+    };
+
+    QList<FactoryInfo> m_factories;
+    const QMetaObject *m_metaObject = nullptr;
+    int m_propertyCount = 0;
+    DocumentModel::Scxml::DataModelType m_dataModel = DocumentModel::Scxml::NullDataModel;
+};
+
+class CompiledStateMachineTable final: public DynamicStateMachineTable,
+                                       public QScxmlInternal::GeneratedTableData
+{
+public:
+    QScxmlTableData *tableData() override
+    { return this; }
+
+    QScxmlInvokableServiceFactory *serviceFactory(int id) const override final
+    { return createServiceFactory(id); }
+};
+
+// Serves the tables straight from a binary table. The storage keeps the memory of the outermost
+// table alive, and is shared with the tables of its inline content.
+class MappedStateMachineTable final: public DynamicStateMachineTable, public QScxmlTableData
+{
+public:
+    MappedStateMachineTable(const QScxmlInternal::BinaryTable::View &view,
+                            const std::shared_ptr<const void> &storage)
+        : m_view(view)
+        , m_storage(storage)
+    {
+        Q_ASSERT(view.isValid());
+    }
+
+    QScxmlTableData *tableData() override
+    { return this; }
+
+    QString string(QScxmlExecutableContent::StringId id) const override final
+    { return m_view.string(id); }
+    QScxmlExecutableContent::InstructionId *instructions() const override final
+    { return m_view.instructions(); }
+    QScxmlExecutableContent::EvaluatorInfo evaluatorInfo(
+            QScxmlExecutableContent::EvaluatorId evaluatorId) const override final
+    { return m_view.evaluatorInfo(evaluatorId); }
+    QScxmlExecutableContent::AssignmentInfo assignmentInfo(
+            QScxmlExecutableContent::EvaluatorId assignmentId) const override final
+    { return m_view.assignmentInfo(assignmentId); }
+    QScxmlExecutableContent::ForeachInfo foreachInfo(
+            QScxmlExecutableContent::EvaluatorId foreachId) const override final
+    { return m_view.foreachInfo(foreachId); }
+    QScxmlExecutableContent::StringId *dataNames(int *count) const override final
+    { return m_view.dataNames(count); }
+    QScxmlExecutableContent::ContainerId initialSetup() const override final
+    { return m_view.initialSetup(); }
+    QString name() const override final
+    { return m_view.string(m_view.name()); }
+    const qint32 *stateMachineTable() const override final
+    { return m_view.stateMachineTable(); }
+    QScxmlInvokableServiceFactory *serviceFactory(int id) const override final
+    { return createServiceFactory(id); }
+
+private:
+    QScxmlInternal::BinaryTable::View m_view;
+    std::shared_ptr<const void> m_storage;
+};
+
+class DynamicStateMachine: public QScxmlStateMachine
 {
     Q_DECLARE_PRIVATE(DynamicStateMachine)
     // Manually expanded from Q_OBJECT macro:
@@ -517,7 +625,7 @@ private:
         } else if (_c == QMetaObject::ReadProperty) {
             DynamicStateMachine *_t = static_cast<DynamicStateMachine *>(_o);
             void *_v = _a[0];
-            if (_id >= 0 && _id < _t->m_propertyCount) {
+            if (_id >= 0 && _id < _t->m_table->m_propertyCount) {
                 // getter for the state
                 *reinterpret_cast<bool*>(_v) = _t->isActive(_id);
             }
@@ -526,28 +634,17 @@ private:
     // end of Q_OBJECT macro
 
 private:
-    DynamicStateMachine()
+    explicit DynamicStateMachine(const QSharedPointer<DynamicStateMachineTable> &table)
         : QScxmlStateMachine(*new DynamicStateMachinePrivate)
-        , m_propertyCount(0)
+        , m_table(table)
     {
-        // Temporarily wire up the QMetaObject
         Q_D(DynamicStateMachine);
-        QMetaObjectBuilder b;
-        b.setClassName("DynamicStateMachine");
-        b.setSuperClass(&QScxmlStateMachine::staticMetaObject);
-        b.setStaticMetacallFunction(qt_static_metacall);
-        d->setDynamicMetaObject(b.toMetaObject());
+        d->setDynamicMetaObject(m_table->m_metaObject);
+        setTableData(m_table->tableData());
     }
 
-    void initDynamicParts(const MetaDataInfo &info)
+    static const QMetaObject *buildMetaObject(const DynamicStateMachineTable::MetaDataInfo &info)
     {
-        Q_D(DynamicStateMachine);
-        // Release the temporary QMetaObject.
-        Q_ASSERT(d->m_metaObject != &QScxmlStateMachine::staticMetaObject);
-        free(const_cast<QMetaObject *>(d->m_metaObject));
-        d->setDynamicMetaObject(&QScxmlStateMachine::staticMetaObject);
-
-        // Build the real one.
         QMetaObjectBuilder b;
         b.setClassName("DynamicStateMachine");
         b.setSuperClass(&QScxmlStateMachine::staticMetaObject);
@@ -566,50 +663,90 @@ private:
         for (const QString &stateName : info.stateNames) {
             QMetaPropertyBuilder prop = b.addProperty(stateName.toUtf8(), "bool", notifier);
             prop.setWritable(false);
-            ++m_propertyCount;
             ++notifier;
         }
 
         // And we're done
-        d->setDynamicMetaObject(b.toMetaObject());
+        return b.toMetaObject();
     }
 
 public:
     ~DynamicStateMachine()
     {
         Q_D(DynamicStateMachine);
-        if (d->m_metaObject != &QScxmlStateMachine::staticMetaObject) {
-            free(const_cast<QMetaObject *>(d->m_metaObject));
-            d->setDynamicMetaObject(&QScxmlStateMachine::staticMetaObject);
-        }
+        // The table index is shared by the address of our table. Release it before the table
+        // can go away, so that it cannot be handed out for another table at the same address.
+        d->m_tableIndex.reset();
+        // The meta object belongs to the table, which may be gone by the time QObject is done.
+        d->setDynamicMetaObject(&QScxmlStateMachine::staticMetaObject);
     }
 
-    QScxmlInvokableServiceFactory *serviceFactory(int id) const override final
-    { return m_allFactoriesById.at(id); }
-
-    static DynamicStateMachine *build(DocumentModel::ScxmlDocument *doc)
+    static QSharedPointer<DynamicStateMachineTable> buildTable(DocumentModel::ScxmlDocument *doc)
     {
-        auto stateMachine = new DynamicStateMachine;
-        MetaDataInfo info;
-        DataModelInfo dm;
-        auto factoryIdCreator = [stateMachine](
+        QSharedPointer<CompiledStateMachineTable> table(new CompiledStateMachineTable);
+        DynamicStateMachineTable::MetaDataInfo info;
+        DynamicStateMachineTable::DataModelInfo dm;
+        QList<QSharedPointer<DocumentModel::ScxmlDocument>> contents;
+        auto factoryIdCreator = [&table, &contents](
                 const QScxmlExecutableContent::InvokeInfo &invokeInfo,
                 const QList<QScxmlExecutableContent::StringId> &namelist,
                 const QList<QScxmlExecutableContent::ParameterInfo> &params,
                 const QSharedPointer<DocumentModel::ScxmlDocument> &content) -> int {
-            auto factory = new InvokeDynamicScxmlFactory(invokeInfo, namelist, params);
-            factory->setContent(content);
-            stateMachine->m_allFactoriesById.append(factory);
-            return stateMachine->m_allFactoriesById.size() - 1;
+            table->m_factories.append({ invokeInfo, namelist, params, nullptr });
+            contents.append(content);
+            return table->m_factories.size() - 1;
         };
 
-        GeneratedTableData::build(doc, stateMachine, &info, &dm, factoryIdCreator);
-        stateMachine->setTableData(stateMachine);
-        stateMachine->initDynamicParts(info);
+        QScxmlInternal::GeneratedTableData::build(doc, table.data(), &info, &dm, factoryIdCreator);
+
+        // Compile inline content right away, so that invoking it only instantiates it.
+        for (qsizetype i = 0; i < contents.size(); ++i) {
+            if (contents.at(i))
+                table->m_factories[i].content = buildTable(contents.at(i).data());
+        }
+
+        table->m_metaObject = buildMetaObject(info);
+        table->m_propertyCount = int(info.stateNames.size());
+        table->m_dataModel = doc->root->dataModel;
+        return table;
+    }
 
+    static QSharedPointer<DynamicStateMachineTable> mapTable(
+            const QScxmlInternal::BinaryTable::View &view,
+            const std::shared_ptr<const void> &storage)
+    {
+        QSharedPointer<MappedStateMachineTable> table(new MappedStateMachineTable(view, storage));
+        for (int i = 0, ei = view.factoryCount(); i < ei; ++i) {
+            const QScxmlInternal::BinaryTable::View content = view.content(i);
+            table->m_factories.append({ view.invokeInfo(i), view.namelist(i), view.params(i),
+                                        content.isValid() ? mapTable(content, storage)
+                                                          : nullptr });
+        }
+
+        const QStringList stateNames = view.stateNames();
+        table->m_metaObject = buildMetaObject({ stateNames });
+        table->m_propertyCount = int(stateNames.size());
+        table->m_dataModel = view.dataModel();
+        return table;
+    }
+
+    // Creates a state machine for the table, with the data model the table asks for.
+    static DynamicStateMachine *create(const QSharedPointer<DynamicStateMachineTable> &table)
+    {
+        auto stateMachine = new DynamicStateMachine(table);
+        QScxmlDataModel *dm = QScxmlDataModelPrivate::instantiateDataModel(table->m_dataModel);
+        QScxmlStateMachinePrivate::get(stateMachine)->parserData()->m_ownedDataModel.reset(dm);
+        stateMachine->setDataModel(dm);
+        if (dm == nullptr)
+            qWarning() << "No data-model instantiated";
         return stateMachine;
     }
 
+    static DynamicStateMachine *build(DocumentModel::ScxmlDocument *doc)
+    {
+        return new DynamicStateMachine(buildTable(doc));
+    }
+
 private:
     static QList<QByteArray> init(const char *s)
     {
@@ -621,8 +758,7 @@ private:
     }
 
 private:
-    QList<QScxmlInvokableServiceFactory *> m_allFactoriesById;
-    int m_propertyCount;
+    const QSharedPointer<DynamicStateMachineTable> m_table;
 };
 
 inline QScxmlInvokableService *InvokeDynamicScxmlFactory::invoke(
@@ -636,12 +772,7 @@ inline QScxmlInvokableService *InvokeDynamicScxmlFactory::invoke(
     if (!srcexpr.isEmpty())
         return invokeDynamicScxmlService(srcexpr, parentStateMachine, this);
 
-    auto childStateMachine = DynamicStateMachine::build(m_content.data());
-
-    auto dm = QScxmlDataModelPrivate::instantiateDataModel(m_content->root->dataModel);
-    dm->setParent(childStateMachine);
-    childStateMachine->setDataModel(dm);
-
+    auto childStateMachine = DynamicStateMachine::create(m_content);
     return invokeStaticScxmlService(childStateMachine, parentStateMachine, this);
 }
 #endif // BUILD_QSCXMLC
@@ -649,6 +780,64 @@ inline QScxmlInvokableService *InvokeDynamicScxmlFactory::invoke(
 } // anonymous namespace
 
 #ifndef BUILD_QSCXMLC
+namespace {
+// Tables compiled from whole documents, keyed by a hash of the file name and the document. An
+// entry lives as long as some state machine uses its table. Documents that load external content
+// are not cached, so the key covers everything a table is compiled from. The table last invoked
+// from each of the most recent <invoke srcexpr="..."> URLs is kept around a little longer,
+// because their state machines tend to come and go in quick succession.
+struct DynamicTableCache
+{
+    enum { MaxRecentlyInvoked = 16 };
+
+    QMutex mutex;
+    QHash<QByteArray, QWeakPointer<DynamicStateMachineTable>> tables;
+    QList<std::pair<QString, QSharedPointer<DynamicStateMachineTable>>> recentlyInvoked;
+
+    static QByteArray key(const QByteArray &data, const QString &fileName)
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        hash.addData(fileName.toUtf8());
+        hash.addData(QByteArrayView("", 1));
+        hash.addData(data);
+        return hash.result();
+    }
+
+    QSharedPointer<DynamicStateMachineTable> value(const QByteArray &key)
+    {
+        QMutexLocker locker(&mutex);
+        return tables.value(key).toStrongRef();
+    }
+
+    void insert(const QByteArray &key, const QSharedPointer<DynamicStateMachineTable> &table)
+    {
+        QMutexLocker locker(&mutex);
+        for (auto it = tables.begin(); it != tables.end();) {
+            if (it.value().isNull())
+                it = tables.erase(it);
+            else
+                ++it;
+        }
+        tables.insert(key, table);
+    }
+
+    // A table invoked from the same URL before is released, even if it was compiled from other
+    // content, so that tables of outdated documents do not linger.
+    void retain(const QString &sourceUrl, const QSharedPointer<DynamicStateMachineTable> &table)
+    {
+        QMutexLocker locker(&mutex);
+        recentlyInvoked.removeIf([&sourceUrl](const auto &entry) {
+            return entry.first == sourceUrl;
+        });
+        recentlyInvoked.prepend({ sourceUrl, table });
+        if (recentlyInvoked.size() > MaxRecentlyInvoked)
+            recentlyInvoked.removeLast();
+    }
+};
+}
+
+Q_GLOBAL_STATIC(DynamicTableCache, dynamicTableCache)
+
 QScxmlScxmlService *invokeDynamicScxmlService(const QString &sourceUrl,
                                               QScxmlStateMachine *parentStateMachine,
                                               QScxmlInvokableServiceFactory *factory)
@@ -664,33 +853,41 @@ QScxmlScxmlService *invokeDynamicScxmlService(const QString &sourceUrl,
         return nullptr;
     }
 
-    QXmlStreamReader reader(data);
-    QScxmlCompiler compiler(&reader);
-    compiler.setFileName(sourceUrl);
-    compiler.setLoader(parentStateMachine->loader());
-    compiler.compile();
-    if (!compiler.errors().isEmpty()) {
-        const auto errors = compiler.errors();
-        for (const QScxmlError &error : errors)
-            qWarning().noquote() << error.toString();
-        return nullptr;
-    }
+    // The loader is asked for the document every time, as it may change. Compiling it is only
+    // done once for the same URL and content. Whatever loader returned the content, the table
+    // compiled from it is the same, unless the document loads more content through the loader.
+    DynamicTableCache *cache = dynamicTableCache();
+    const QByteArray key = DynamicTableCache::key(data, sourceUrl);
+    QSharedPointer<DynamicStateMachineTable> table = cache->value(key);
+    if (table) {
+        cache->retain(sourceUrl, table);
+    } else {
+        QXmlStreamReader reader(data);
+        QScxmlCompiler compiler(&reader);
+        compiler.setFileName(sourceUrl);
+        compiler.setLoader(parentStateMachine->loader());
+        QScxmlCompilerPrivate *d = QScxmlCompilerPrivate::get(&compiler);
+        d->readDocument();
+        if (d->errors().isEmpty())
+            d->verifyDocument();
+
+        auto mainDoc = d->scxmlDocument();
+        if (mainDoc == nullptr || mainDoc->root == nullptr) {
+            Q_ASSERT(!compiler.errors().isEmpty());
+            const auto errors = compiler.errors();
+            for (const QScxmlError &error : errors)
+                qWarning().noquote() << error.toString();
+            return nullptr;
+        }
 
-    auto mainDoc = QScxmlCompilerPrivate::get(&compiler)->scxmlDocument();
-    if (mainDoc == nullptr) {
-        Q_ASSERT(!compiler.errors().isEmpty());
-        const auto errors = compiler.errors();
-        for (const QScxmlError &error : errors)
-            qWarning().noquote() << error.toString();
-        return nullptr;
+        table = DynamicStateMachine::buildTable(mainDoc);
+        if (!d->hasExternalContent()) {
+            cache->insert(key, table);
+            cache->retain(sourceUrl, table);
+        }
     }
 
-    auto childStateMachine = DynamicStateMachine::build(mainDoc);
-
-    auto dm = QScxmlDataModelPrivate::instantiateDataModel(mainDoc->root->dataModel);
-    dm->setParent(childStateMachine);
-    childStateMachine->setDataModel(dm);
-
+    auto childStateMachine = DynamicStateMachine::create(table);
     return invokeStaticScxmlService(childStateMachine, parentStateMachine, factory);
 }
 #endif // BUILD_QSCXMLC
@@ -788,6 +985,86 @@ QScxmlStateMachine *QScxmlCompiler::compile()
     return d->instantiateStateMachine();
 }
 
+/*!
+ * \internal
+ * Creates a state machine from the SCXML document in \a data, read from \a fileName.
+ *
+ * Documents that compile without errors are cached. If a state machine that was created from the
+ * same file name and data is still alive, the new one shares its tables and meta object instead
+ * of parsing and compiling the document again.
+ *
+ * Documents that load external content, through the src attribute of <script>, <data> or
+ * <invoke>, are not cached. That content is not part of the key and may have changed.
+ */
+QScxmlStateMachine *QScxmlCompilerPrivate::compileShared(const QByteArray &data,
+                                                         const QString &fileName)
+{
+#ifdef BUILD_QSCXMLC
+    Q_UNUSED(data);
+    Q_UNUSED(fileName);
+    return nullptr;
+#else // BUILD_QSCXMLC
+    DynamicTableCache *cache = dynamicTableCache();
+    const QByteArray key = DynamicTableCache::key(data, fileName);
+    if (auto table = cache->value(key))
+        return DynamicStateMachine::create(table);
+
+    QXmlStreamReader reader(data);
+    QScxmlCompiler compiler(&reader);
+    compiler.setFileName(fileName);
+    QScxmlCompilerPrivate *d = get(&compiler);
+    d->readDocument();
+    if (d->errors().isEmpty())
+        d->verifyDocument();
+
+    DocumentModel::ScxmlDocument *doc = d->scxmlDocument();
+    if (!doc || !doc->root)
+        return d->instantiateStateMachine();
+
+    auto table = DynamicStateMachine::buildTable(doc);
+    if (!d->hasExternalContent())
+        cache->insert(key, table);
+    return DynamicStateMachine::create(table);
+#endif // BUILD_QSCXMLC
+}
+
+/*!
+ * \internal
+ * Creates a state machine from the binary table in the file \a fileName.
+ *
+ * The table is used where it is, mapped into memory if possible. It is released when the state
+ * machine and all state machines it invokes from inline content are gone. Returns \c nullptr if
+ * the file cannot be read, or does not contain a valid binary table for this version of Qt SCXML.
+ */
+QScxmlStateMachine *QScxmlCompilerPrivate::instantiateBinaryTable(const QString &fileName)
+{
+#ifdef BUILD_QSCXMLC
+    Q_UNUSED(fileName);
+    return nullptr;
+#else // BUILD_QSCXMLC
+    // The mapping lives as long as the file is open, that is, as long as the QFile.
+    auto file = std::make_shared<QFile>(fileName);
+    if (!file->open(QIODevice::ReadOnly))
+        return nullptr;
+
+    std::shared_ptr<const void> storage = file;
+    qsizetype size = file->size();
+    const uchar *data = file->map(0, size);
+    if (!data) {
+        // Compressed resources, for example, cannot be mapped.
+        auto bytes = std::make_shared<QByteArray>(file->readAll());
+        data = reinterpret_cast<const uchar *>(bytes->constData());
+        size = bytes->size();
+        storage = bytes;
+    }
+
+    const QScxmlInternal::BinaryTable::View view(data, size);
+    if (!view.isValid())
+        return nullptr;
+    return DynamicStateMachine::create(DynamicStateMachine::mapTable(view, storage));
+#endif // BUILD_QSCXMLC
+}
+
 /*!
  * \internal
  * Instantiates a new state machine from the parsed SCXML.
@@ -1365,6 +1642,7 @@ void QScxmlCompilerPrivate::parseSubDocument(DocumentModel::Invoke *parentInvoke
     p.setLoader(loader());
     p.d->readDocument();
     parentInvoke->content.reset(p.d->m_doc.release());
+    m_hasExternalContent |= p.d->m_hasExternalContent;
     m_doc->allSubDocuments.append(parentInvoke->content.data());
     m_errors.append(p.errors());
 }
@@ -1379,6 +1657,7 @@ bool QScxmlCompilerPrivate::parseSubElement(DocumentModel::Invoke *parentInvoke,
     p.d->resetDocument();
     bool ok = p.d->readElement();
     parentInvoke->content.reset(p.d->m_doc.release());
+    m_hasExternalContent |= p.d->m_hasExternalContent;
     m_doc->allSubDocuments.append(parentInvoke->content.data());
     m_errors.append(p.errors());
     return ok;
@@ -2311,6 +2590,8 @@ bool QScxmlCompilerPrivate::flushInstruction()
 
 QByteArray QScxmlCompilerPrivate::load(const QString &name, bool *ok)
 {
+    m_hasExternalContent = true;
+
     QStringList errs;
     const QByteArray result = m_loader->load(name, m_fileName.isEmpty() ?
                               QString() : QFileInfo(m_fileName).path(), &errs);
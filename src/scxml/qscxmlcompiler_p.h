@@ -540,12 +540,15 @@ public:
                          QXmlStreamReader *reader,
                          const QString &fileName);
     QByteArray load(const QString &name, bool *ok);
+    bool hasExternalContent() const { return m_hasExternalContent; }
 
     QList<QScxmlError> errors() const;
 
     void addError(const QString &msg);
     void addError(const DocumentModel::XmlLocation &location, const QString &msg);
     QScxmlStateMachine *instantiateStateMachine() const;
+    static QScxmlStateMachine *compileShared(const QByteArray &data, const QString &fileName);
+    static QScxmlStateMachine *instantiateBinaryTable(const QString &fileName);
     void instantiateDataModel(QScxmlStateMachine *stateMachine) const;
 
 private:
@@ -690,6 +693,7 @@ private:
     DocumentModel::StateContainer *m_currentState;
     DefaultLoader m_defaultLoader;
     QScxmlCompiler::Loader *m_loader;
+    bool m_hasExternalContent = false;
 
     QXmlStreamReader *m_reader;
     QList<ParserState> m_stack;
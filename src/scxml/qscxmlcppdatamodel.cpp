@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only OR GPL-3.0-only
 
 #include "qscxmlcppdatamodel_p.h"
+#include "qscxmlevent_p.h"
 #include "qscxmlstatemachine.h"
 
 QT_BEGIN_NAMESPACE
@@ -68,7 +69,7 @@ bool TheDataModel::evaluateToBool(QScxmlExecutableContent::EvaluatorId id, bool
 
 QVariant TheDataModel::evaluateToVariant(QScxmlExecutableContent::EvaluatorId id, bool *ok) {
     // ....
-        return [this]()->QVariant{ return media; }();
+        return scxmlVariant([this]{ return media; }());
     // ....
 }
 
@@ -84,6 +85,22 @@ void TheDataModel::evaluateToVoid(QScxmlExecutableContent::EvaluatorId id, bool
    converted to the respective bool or QVariant. And, as the \c this pointer is also captured, you
    can call or access the data model (the \e media attribute in the example above). For the full
    example, see \l {SCXML Media Player}.
+
+   Since Qt 6.10, an \e expr attribute that yields a value of a type that cannot be converted to
+   QVariant is stored with QVariant::fromValue(). This way, an event can carry a value of your own
+   type as its data, instead of a QVariantMap built from \c <param> elements:
+   \code
+    <send event="playbackStarted">
+        <content expr="PlaybackStarted{ media, position }"/>
+    </send>
+   \endcode
+   The receiving data model reads the value with eventPayload(), without looking up any keys:
+   \code
+    if (const PlaybackStarted *payload = eventPayload<PlaybackStarted>())
+        media = payload->media;
+   \endcode
+   Application code can submit such events with the QScxmlStateMachine::submitEvent() overload
+   that takes a payload of any type.
  */
 
 /*!
@@ -224,6 +241,33 @@ bool QScxmlCppDataModel::setScxmlProperty(const QString &name, const QVariant &v
     return false;
 }
 
+/*!
+    \fn template <typename T> const T *QScxmlCppDataModel::eventPayload() const
+    \since 6.10
+
+    Returns a pointer to the data of the event that is being processed, if the data holds a value
+    of type \c T, and \nullptr otherwise. The value is not converted or copied. The pointer is
+    valid until the next event is set on the data model.
+
+    \sa scxmlEvent(), QScxmlStateMachine::submitEvent()
+ */
+
+/*!
+    \fn template <typename T> QVariant QScxmlCppDataModel::scxmlVariant(T &&value)
+    \since 6.10
+    \internal
+
+    Converts the result of an expression to QVariant for the evaluators that the Qt SCXML compiler
+    generates. Types that QVariant can be constructed from implicitly are converted as before, and
+    other types are stored with QVariant::fromValue().
+ */
+
+const QVariant &QScxmlCppDataModel::scxmlEventData() const
+{
+    Q_D(const QScxmlCppDataModel);
+    return QScxmlEventPrivate::data(d->event);
+}
+
 /*!
   Returns \c true if the state machine is in the state specified by
   \a stateName, \c false otherwise.
@@ -6,6 +6,8 @@
 
 #include <QtScxml/qscxmldatamodel.h>
 
+#include <type_traits>
+
 #define Q_SCXML_DATAMODEL \
     public: \
         QString evaluateToString(QScxmlExecutableContent::EvaluatorId id, bool *ok) override final; \
@@ -38,6 +40,25 @@ public:
     bool setScxmlProperty(const QString &name, const QVariant &value, const QString &context) override;
 
     bool inState(const QString &stateName) const;
+
+    template <typename T>
+    const T *eventPayload() const
+    {
+        return get_if<T>(&scxmlEventData());
+    }
+
+protected:
+    template <typename T>
+    static QVariant scxmlVariant(T &&value)
+    {
+        if constexpr (std::is_convertible_v<T &&, QVariant>)
+            return std::forward<T>(value);
+        else
+            return QVariant::fromValue(std::forward<T>(value));
+    }
+
+private:
+    const QVariant &scxmlEventData() const;
 };
 
 QT_END_NAMESPACE
@@ -14,6 +14,90 @@ using namespace QScxmlExecutableContent;
 
 QAtomicInt QScxmlEventBuilder::idCounter = QAtomicInt(0);
 
+namespace {
+// The pool and its state are trivially destructible, so that they can still be used by events
+// that are deleted while the thread exits, after EventPrivatePoolCleanup has released the pool.
+struct EventPrivatePool
+{
+    enum { MaxFree = 64 };
+
+    void *free[MaxFree];
+    int count;
+};
+
+enum class EventPrivatePoolState : quint8 { Unused, Alive, Released };
+
+thread_local EventPrivatePool eventPrivatePool = {};
+thread_local EventPrivatePoolState eventPrivatePoolState = EventPrivatePoolState::Unused;
+
+struct EventPrivatePoolCleanup
+{
+    EventPrivatePoolCleanup() { eventPrivatePoolState = EventPrivatePoolState::Alive; }
+
+    ~EventPrivatePoolCleanup()
+    {
+        eventPrivatePoolState = EventPrivatePoolState::Released;
+        EventPrivatePool &pool = eventPrivatePool;
+        while (pool.count > 0)
+            ::operator delete(pool.free[--pool.count]);
+    }
+};
+
+// Frees the pooled blocks when the thread exits. Called before the first block is pooled.
+void registerEventPrivatePoolCleanup()
+{
+    static thread_local EventPrivatePoolCleanup cleanup;
+    Q_UNUSED(cleanup);
+}
+} // anonymous namespace
+
+QScxmlEventPrivate::NameKind QScxmlEventPrivate::classifyName(const QString &name)
+{
+    if (name.startsWith(QLatin1String("error.")))
+        return ErrorName;
+    if (name.startsWith(QLatin1String("done.invoke.")))
+        return DoneInvokeName;
+    return OtherName;
+}
+
+QScxmlEventPrivate::OriginKind QScxmlEventPrivate::classifyOrigin(const QString &origin)
+{
+    if (!origin.startsWith(QLatin1String("#_")))
+        return OtherOrigin;
+    if (origin == QLatin1String("#_parent"))
+        return ParentOrigin;
+    if (origin == QLatin1String("#_internal"))
+        return InternalOrigin;
+    return ChildOrigin;
+}
+
+void *QScxmlEventPrivate::operator new(size_t size)
+{
+    Q_ASSERT(size == sizeof(QScxmlEventPrivate));
+    EventPrivatePool &pool = eventPrivatePool;
+    if (pool.count > 0)
+        return pool.free[--pool.count];
+    return ::operator new(size);
+}
+
+void QScxmlEventPrivate::operator delete(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    if (eventPrivatePoolState == EventPrivatePoolState::Unused)
+        registerEventPrivatePoolCleanup();
+
+    // Events deleted during thread exit bypass the pool.
+    EventPrivatePool &pool = eventPrivatePool;
+    if (eventPrivatePoolState == EventPrivatePoolState::Alive
+            && pool.count < EventPrivatePool::MaxFree) {
+        pool.free[pool.count++] = ptr;
+    } else {
+        ::operator delete(ptr);
+    }
+}
+
 QScxmlEvent *QScxmlEventBuilder::buildEvent()
 {
     auto dataModel = stateMachine ? stateMachine->dataModel() : nullptr;
@@ -42,7 +126,8 @@ QScxmlEvent *QScxmlEventBuilder::buildEvent()
         if (evaluate(params, stateMachine, keyValues)) {
             if (namelist) {
                 for (qint32 i = 0; i < namelist->count; ++i) {
-                    QString name = tableData->string(namelist->const_data()[i]);
+                    const QString name = sendInfo ? sendInfo->namelist.at(i)
+                                                  : tableData->string(namelist->const_data()[i]);
                     keyValues.insert(name, dataModel->scxmlProperty(name));
                 }
             }
@@ -57,7 +142,7 @@ QScxmlEvent *QScxmlEventBuilder::buildEvent()
     QString sendid = id;
     if (!idLocation.isEmpty()) {
         sendid = generateId();
-        ok = stateMachine->dataModel()->setScxmlProperty(idLocation, sendid, tableData->string(instructionLocation));
+        ok = stateMachine->dataModel()->setScxmlProperty(idLocation, sendid, locationString());
         if (!ok)
             return nullptr;
     }
@@ -78,14 +163,14 @@ QScxmlEvent *QScxmlEventBuilder::buildEvent()
         // [6.2.4] and test194.
         submitError(QStringLiteral("error.execution"),
                     QStringLiteral("Error in %1: %2 is not a legal target")
-                    .arg(tableData->string(instructionLocation), origin),
+                    .arg(locationString(), origin),
                     sendid);
         return nullptr;
     } else if (!stateMachine->isDispatchableTarget(origin)) {
         // [6.2.4] and test521.
         submitError(QStringLiteral("error.communication"),
                     QStringLiteral("Error in %1: cannot dispatch to target '%2'")
-                    .arg(tableData->string(instructionLocation), origin),
+                    .arg(locationString(), origin),
                     sendid);
         return nullptr;
     }
@@ -105,7 +190,7 @@ QScxmlEvent *QScxmlEventBuilder::buildEvent()
         // [6.2.5] and test199
         submitError(QStringLiteral("error.execution"),
                     QStringLiteral("Error in %1: %2 is not a valid type")
-                    .arg(tableData->string(instructionLocation), origintype),
+                    .arg(locationString(), origintype),
                     sendid);
         return nullptr;
     }
@@ -140,34 +225,29 @@ QScxmlEvent *QScxmlEventBuilder::errorEvent(QScxmlStateMachine *stateMachine, co
     return error;
 }
 
-bool QScxmlEventBuilder::evaluate(const ParameterInfo &param, QScxmlStateMachine *stateMachine,
+bool QScxmlEventBuilder::evaluate(const ParameterInfo &param, const QString &name,
+                                  const QString &location, QScxmlStateMachine *stateMachine,
                                   QVariantMap &keyValues)
 {
     auto dataModel = stateMachine->dataModel();
-    auto tableData = stateMachine->tableData();
     if (param.expr != NoEvaluator) {
         bool success = false;
         auto v = dataModel->evaluateToVariant(param.expr, &success);
-        keyValues.insert(tableData->string(param.name), v);
+        keyValues.insert(name, v);
         return success;
     }
 
-    QString loc;
-    if (param.location != QScxmlExecutableContent::NoString) {
-        loc = tableData->string(param.location);
-    }
-
-    if (loc.isEmpty()) {
+    if (location.isEmpty()) {
         return false;
     }
 
-    if (dataModel->hasScxmlProperty(loc)) {
-        keyValues.insert(tableData->string(param.name), dataModel->scxmlProperty(loc));
+    if (dataModel->hasScxmlProperty(location)) {
+        keyValues.insert(name, dataModel->scxmlProperty(location));
         return true;
     } else {
         submitError(QStringLiteral("error.execution"),
                     QStringLiteral("Error in <param>: %1 is not a valid location")
-                    .arg(loc));
+                    .arg(location));
         return false;
     }
 }
@@ -178,9 +258,20 @@ bool QScxmlEventBuilder::evaluate(const QScxmlExecutableContent::Array<Parameter
     if (!params)
         return true;
 
+    auto tableData = stateMachine->tableData();
     auto paramPtr = params->const_data();
     for (qint32 i = 0; i != params->count; ++i, ++paramPtr) {
-        if (!evaluate(*paramPtr, stateMachine, keyValues))
+        bool ok;
+        if (sendInfo) {
+            ok = evaluate(*paramPtr, sendInfo->paramNames.at(i), sendInfo->paramLocations.at(i),
+                          stateMachine, keyValues);
+        } else {
+            const QString location = paramPtr->location == NoString
+                    ? QString() : tableData->string(paramPtr->location);
+            ok = evaluate(*paramPtr, tableData->string(paramPtr->name), location, stateMachine,
+                          keyValues);
+        }
+        if (!ok)
             return false;
     }
 
@@ -316,6 +407,7 @@ QString QScxmlEvent::name() const
 void QScxmlEvent::setName(const QString &name)
 {
     d->name = name;
+    d->nameKind = QScxmlEventPrivate::classifyName(name);
 }
 
 /*!
@@ -372,6 +464,7 @@ QString QScxmlEvent::origin() const
 void QScxmlEvent::setOrigin(const QString &origin)
 {
     d->origin = origin;
+    d->originKind = QScxmlEventPrivate::classifyOrigin(origin);
 }
 
 /*!
@@ -517,7 +610,7 @@ void QScxmlEvent::setData(const QVariant &data)
  */
 bool QScxmlEvent::isErrorEvent() const
 {
-    return eventType() == PlatformEvent && name().startsWith(QStringLiteral("error."));
+    return eventType() == PlatformEvent && d->nameKind == QScxmlEventPrivate::ErrorName;
 }
 
 /*!
@@ -75,6 +75,7 @@ public:
     void setErrorMessage(const QString &message);
 
 private:
+    friend class QScxmlEventPrivate;
     QScxmlEventPrivate *d;
 
 };
@@ -24,6 +24,8 @@
 
 #include <QtCore/qatomic.h>
 
+#include <charconv>
+
 QT_BEGIN_NAMESPACE
 
 #ifndef BUILD_QSCXMLC
@@ -44,13 +46,20 @@ class QScxmlEventBuilder
     QString type;
     QScxmlExecutableContent::EvaluatorId typeexpr;
     const QScxmlExecutableContent::Array<QScxmlExecutableContent::StringId> *namelist;
+    const QScxmlInternal::SendInfo *sendInfo; // the names of the namelist and the params
 
     static QAtomicInt idCounter;
     QString generateId() const
     {
-        QString id = QString::number(++idCounter);
-        id.prepend(QStringLiteral("id-"));
-        return id;
+        char id[16] = { 'i', 'd', '-' };
+        const auto end = std::to_chars(id + 3, id + sizeof(id), int(++idCounter)).ptr;
+        return QString::fromLatin1(id, end - id);
+    }
+
+    QString locationString() const
+    {
+        return sendInfo ? sendInfo->instructionLocation
+                        : stateMachine->tableData()->string(instructionLocation);
     }
 
     QScxmlEventBuilder()
@@ -66,6 +75,7 @@ class QScxmlEventBuilder
         targetexpr = QScxmlExecutableContent::NoEvaluator;
         typeexpr = QScxmlExecutableContent::NoEvaluator;
         namelist = nullptr;
+        sendInfo = nullptr;
     }
 
 public:
@@ -82,21 +92,23 @@ public:
         eventType = QScxmlEvent::InternalEvent;
     }
 
-    QScxmlEventBuilder(QScxmlStateMachine *stateMachine, const QScxmlExecutableContent::Send &send)
+    QScxmlEventBuilder(QScxmlStateMachine *stateMachine, const QScxmlExecutableContent::Send &send,
+                       const QScxmlInternal::SendInfo &info)
     {
         init();
         this->stateMachine = stateMachine;
+        sendInfo = &info;
         instructionLocation = send.instructionLocation;
-        event = stateMachine->tableData()->string(send.event);
+        event = info.event;
         eventexpr = send.eventexpr;
-        contents = stateMachine->tableData()->string(send.content);
+        contents = info.content;
         contentExpr = send.contentexpr;
         params = send.params();
-        id = stateMachine->tableData()->string(send.id);
-        idLocation = stateMachine->tableData()->string(send.idLocation);
-        target = stateMachine->tableData()->string(send.target);
+        id = info.id;
+        idLocation = info.idLocation;
+        target = info.target;
         targetexpr = send.targetexpr;
-        type = stateMachine->tableData()->string(send.type);
+        type = info.type;
         typeexpr = send.typeexpr;
         namelist = &send.namelist;
     }
@@ -108,8 +120,9 @@ public:
     static QScxmlEvent *errorEvent(QScxmlStateMachine *stateMachine, const QString &name,
                                    const QString &message, const QString &sendid);
 
-    bool evaluate(const QScxmlExecutableContent::ParameterInfo &param,
-                  QScxmlStateMachine *stateMachine, QVariantMap &keyValues);
+    bool evaluate(const QScxmlExecutableContent::ParameterInfo &param, const QString &name,
+                  const QString &location, QScxmlStateMachine *stateMachine,
+                  QVariantMap &keyValues);
 
     bool evaluate(
             const QScxmlExecutableContent::Array<QScxmlExecutableContent::ParameterInfo> *params,
@@ -127,6 +140,28 @@ public:
         , delayInMiliSecs(0)
     {}
 
+    // The parts of the name and the origin that the interpreter dispatches on are classified
+    // when they are set, so that routing does not compare strings for every event.
+    enum NameKind : quint8 {
+        OtherName,
+        ErrorName, // "error.*"
+        DoneInvokeName // "done.invoke.*"
+    };
+
+    enum OriginKind : quint8 {
+        OtherOrigin, // empty, or an external URI
+        ParentOrigin, // "#_parent"
+        InternalOrigin, // "#_internal"
+        ChildOrigin // "#_<invokeid>"
+    };
+
+    static NameKind classifyName(const QString &name);
+    static OriginKind classifyOrigin(const QString &origin);
+
+    static NameKind nameKind(const QScxmlEvent *event) { return event->d->nameKind; }
+    static OriginKind originKind(const QScxmlEvent *event) { return event->d->originKind; }
+    static const QVariant &data(const QScxmlEvent &event) { return event.d->data; }
+
     QString name;
     QScxmlEvent::EventType eventType;
     QVariant data; // extra data
@@ -135,8 +170,15 @@ public:
     QString originType; // type to answer by setting the type of send, empty for internal and platform events
     QString invokeId; // id of the invocation that triggered the child process if this was invoked
     int delayInMiliSecs;
+    NameKind nameKind = OtherName;
+    OriginKind originKind = OtherOrigin;
 
     static QByteArray debugString(QScxmlEvent *event);
+
+    // Event data is allocated from a small free list per thread, so that the stream of events
+    // that a state machine creates and deletes does not go through the allocator every time.
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
 };
 
 QT_END_NAMESPACE
@@ -6,6 +6,12 @@
 #include "qscxmlcompiler_p.h"
 #include "qscxmlevent_p.h"
 
+#ifndef BUILD_QSCXMLC
+#include "qscxmlstatemachine_p.h"
+#endif // BUILD_QSCXMLC
+
+#include <algorithm>
+
 QT_BEGIN_NAMESPACE
 
 using namespace QScxmlExecutableContent;
@@ -234,234 +240,417 @@ static int parseTime(QStringView t, bool *ok = nullptr)
     return negative ? -value : value;
 }
 
-QScxmlExecutionEngine::QScxmlExecutionEngine(QScxmlStateMachine *stateMachine)
-    : stateMachine(stateMachine)
+namespace QScxmlInternal {
+
+typedef ExecutableCode::Frame Frame;
+typedef ExecutableCode::Op Op;
+
+static int runJump(Frame *, const Op &op, int, bool *)
 {
-    Q_ASSERT(stateMachine);
+    return op.jump;
 }
 
-bool QScxmlExecutionEngine::execute(ContainerId id, const QVariant &extraData)
+static int runSend(Frame *frame, const Op &op, int pc, bool *ok)
 {
-    Q_ASSERT(stateMachine);
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing send step";
+    const Send *send = reinterpret_cast<const Send *>(op.instruction);
+    const SendInfo &info = frame->code->sendInfo(op);
+
+    QString delay = op.string;
+    int msecs = info.delay;
+    if (send->delayexpr != NoEvaluator) {
+        delay = frame->dataModel->evaluateToString(send->delayexpr, ok);
+        if (!(*ok))
+            return pc + 1;
+        msecs = delay.isEmpty() ? 0 : parseTime(delay);
+    }
 
-    if (id == NoInstruction)
-        return true;
+    QScxmlEvent *event = QScxmlEventBuilder(frame->stateMachine, *send, info).buildEvent();
+    if (!event) {
+        *ok = false;
+        return pc + 1;
+    }
+
+    if (msecs < 0) {
+        qCDebug(qscxmlLog) << frame->stateMachine << "failed to parse delay time" << delay;
+        delete event;
+        *ok = false;
+        return pc + 1;
+    }
+    if (msecs > 0)
+        event->setDelay(msecs);
+
+    frame->stateMachine->submitEvent(event);
+    return pc + 1;
+}
+
+static int runJavaScript(Frame *frame, const Op &op, int pc, bool *ok)
+{
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing script step";
+    const JavaScript *javascript = reinterpret_cast<const JavaScript *>(op.instruction);
+    frame->dataModel->evaluateToVoid(javascript->go, ok);
+    return pc + 1;
+}
+
+static int runIf(Frame *frame, const Op &op, int, bool *)
+{
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing if step";
+    const ExecutableCode::Branch *branch = frame->code->branches(op);
+    for (const auto *end = branch + op.branchCount; branch != end; ++branch) {
+        bool conditionOk = true;
+        if (frame->dataModel->evaluateToBool(branch->condition, &conditionOk) && conditionOk)
+            return branch->target;
+    }
+    return op.jump;
+}
+
+static int runForeach(Frame *frame, const Op &op, int pc, bool *ok)
+{
+    class LoopBody: public QScxmlDataModel::ForeachLoopBody
+    {
+        Frame *frame;
+        int first;
+        int last;
+
+    public:
+        LoopBody(Frame *frame, int first, int last)
+            : frame(frame)
+            , first(first)
+            , last(last)
+        {}
+
+        void run(bool *ok) override
+        {
+            *ok = frame->code->run(frame, first, last);
+        }
+    };
+
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing foreach step";
+    const Foreach *_foreach = reinterpret_cast<const Foreach *>(op.instruction);
+    LoopBody body(frame, pc + 1, op.jump);
+    frame->dataModel->evaluateForeach(_foreach->doIt, ok, &body);
+    return op.jump;
+}
+
+static int runRaise(Frame *frame, const Op &op, int pc, bool *)
+{
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing raise step";
+    auto event = new QScxmlEvent;
+    event->setName(op.string);
+    event->setEventType(QScxmlEvent::InternalEvent);
+    frame->stateMachine->submitEvent(event);
+    return pc + 1;
+}
+
+static int runLog(Frame *frame, const Op &op, int pc, bool *ok)
+{
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing log step";
+    const Log *log = reinterpret_cast<const Log *>(op.instruction);
+    QString str;
+    if (log->expr != NoEvaluator) {
+        str = frame->dataModel->evaluateToString(log->expr, ok);
+        if (!*ok) {
+            qCWarning(qscxmlLog) << frame->stateMachine
+                                 << "Could not evaluate <log> expr to string.";
+        }
+    }
+
+    qCDebug(scxmlLog) << op.string << ":" << str;
+    QMetaObject::invokeMethod(frame->stateMachine,
+                              "log",
+                              Qt::QueuedConnection,
+                              Q_ARG(QString, op.string),
+                              Q_ARG(QString, str));
+    return pc + 1;
+}
+
+static int runCancel(Frame *frame, const Op &op, int pc, bool *ok)
+{
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing cancel step";
+    const Cancel *cancel = reinterpret_cast<const Cancel *>(op.instruction);
+    QString e = op.string;
+    if (cancel->sendidexpr != NoEvaluator)
+        e = frame->dataModel->evaluateToString(cancel->sendidexpr, ok);
+    if (*ok && !e.isEmpty())
+        frame->stateMachine->cancelDelayedEvent(e);
+    return pc + 1;
+}
+
+static int runAssign(Frame *frame, const Op &op, int pc, bool *ok)
+{
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing assign step";
+    const Assign *assign = reinterpret_cast<const Assign *>(op.instruction);
+    frame->dataModel->evaluateAssignment(assign->expression, ok);
+    return pc + 1;
+}
+
+static int runInitialize(Frame *frame, const Op &op, int pc, bool *ok)
+{
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing initialize step";
+    const Initialize *init = reinterpret_cast<const Initialize *>(op.instruction);
+    frame->dataModel->evaluateInitialization(init->expression, ok);
+    return pc + 1;
+}
+
+static int runDoneData(Frame *frame, const Op &op, int pc, bool *)
+{
+    qCDebug(qscxmlLog) << frame->stateMachine << "Executing DoneData step";
+    const DoneData *doneData = reinterpret_cast<const DoneData *>(op.instruction);
+
+    QString eventName = QStringLiteral("done.state.") + frame->extraData->toString();
+    QScxmlEventBuilder event(frame->stateMachine, eventName, doneData);
+    auto e = event();
+    e->setEventType(QScxmlEvent::InternalEvent);
+    qCDebug(qscxmlLog) << frame->stateMachine << "submitting event" << eventName;
+    frame->stateMachine->submitEvent(e);
+    return pc + 1;
+}
+
+static SendInfo decodeSend(const QScxmlTableData *tableData, const Send *send,
+                           const QString &delay)
+{
+    SendInfo info;
+    info.event = tableData->string(send->event);
+    info.type = tableData->string(send->type);
+    info.target = tableData->string(send->target);
+    info.id = tableData->string(send->id);
+    info.idLocation = tableData->string(send->idLocation);
+    info.content = tableData->string(send->content);
+    info.instructionLocation = tableData->string(send->instructionLocation);
+
+    info.namelist.reserve(send->namelist.count);
+    for (qint32 i = 0; i != send->namelist.count; ++i)
+        info.namelist.append(tableData->string(send->namelist.at(i)));
+
+    const Array<ParameterInfo> *params = send->params();
+    info.paramNames.reserve(params->count);
+    info.paramLocations.reserve(params->count);
+    for (qint32 i = 0; i != params->count; ++i) {
+        info.paramNames.append(tableData->string(params->at(i).name));
+        const StringId location = params->at(i).location;
+        info.paramLocations.append(location == NoString ? QString() : tableData->string(location));
+    }
+
+    info.delay = delay.isEmpty() ? 0 : parseTime(delay);
+    return info;
+}
+
+void ExecutableCode::add(const QScxmlTableData *tableData, ContainerId id)
+{
+    if (id == NoInstruction || m_containers.contains(id))
+        return;
+
+    const int first = int(m_ops.size());
+    decode(tableData, tableData->instructions() + id, Abort);
+    m_containers.insert(id, { first, int(m_ops.size()) });
+}
 
-    const InstructionId *ip = stateMachine->tableData()->instructions() + id;
-    this->extraData = extraData;
-    bool result = true;
-    step(ip, &result);
-    this->extraData = QVariant();
-    return result;
+bool ExecutableCode::execute(Frame *frame, ContainerId id) const
+{
+    Q_ASSERT(m_containers.contains(id));
+    const Range range = m_containers.value(id);
+    return run(frame, range.first, range.last);
+}
+
+bool ExecutableCode::run(Frame *frame, int first, int last) const
+{
+    bool ok = true;
+    for (int pc = first; pc < last;) {
+        const Op &op = m_ops[size_t(pc)];
+        pc = op.handler(frame, op, pc, &ok);
+        if (!ok) {
+            if (op.onFailure == Abort)
+                return false;
+            pc = op.onFailure;
+            ok = true;
+        }
+    }
+    return true;
+}
+
+int ExecutableCode::addOp(Handler handler, const Instruction *instruction, int onFailure,
+                          const QString &string)
+{
+    m_ops.push_back({ handler, instruction, string, 0, 0, 0, 0, onFailure });
+    return int(m_ops.size()) - 1;
 }
 
-const InstructionId *QScxmlExecutionEngine::step(const InstructionId *ip, bool *ok)
+void ExecutableCode::decodeSequence(const QScxmlTableData *tableData,
+                                    const InstructionSequence *sequence, int onFailure)
 {
-    auto dataModel = stateMachine->dataModel();
-    auto tableData = stateMachine->tableData();
+    const InstructionId *ip = sequence->instructions();
+    const InstructionId *end = ip + sequence->entryCount;
+    while (ip < end)
+        ip = decode(tableData, ip, onFailure);
+}
 
-    *ok = true;
+const InstructionId *ExecutableCode::decode(const QScxmlTableData *tableData,
+                                            const InstructionId *ip, int onFailure)
+{
     auto instr = reinterpret_cast<const Instruction *>(ip);
     switch (instr->instructionType) {
     case Instruction::Sequence: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing sequence step";
         const InstructionSequence *sequence = reinterpret_cast<const InstructionSequence *>(instr);
-        ip = sequence->instructions();
-        const InstructionId *end = ip + sequence->entryCount;
-        while (ip < end) {
-            ip = step(ip, ok);
-            if (!(*ok)) {
-                qCDebug(qscxmlLog) << stateMachine << "Finished sequence step UNsuccessfully";
-                return end;
-            }
-        }
-        qCDebug(qscxmlLog) << stateMachine << "Finished sequence step successfully";
-        return ip;
+        decodeSequence(tableData, sequence, onFailure);
+        return ip + sequence->size();
     }
 
     case Instruction::Sequences: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing sequences step";
+        // A failing sequence does not keep the following ones from running.
         const InstructionSequences *sequences
                 = reinterpret_cast<const InstructionSequences *>(instr);
-        ip += sequences->size();
+        const InstructionId *sequence
+                = reinterpret_cast<const InstructionId *>(sequences->sequences());
         for (int i = 0; i != sequences->sequenceCount; ++i) {
-            bool ignored;
-            const InstructionId *sequence = sequences->at(i);
-            step(sequence, &ignored);
+            const size_t first = m_ops.size();
+            sequence = decode(tableData, sequence, NextSequence);
+            const int next = int(m_ops.size());
+            for (size_t op = first; op < m_ops.size(); ++op) {
+                if (m_ops[op].onFailure == NextSequence)
+                    m_ops[op].onFailure = next;
+            }
         }
-        qCDebug(qscxmlLog) << stateMachine << "Finished sequences step";
-        return ip;
+        return ip + sequences->size();
     }
 
     case Instruction::Send: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing send step";
         const Send *send = reinterpret_cast<const Send *>(instr);
-        ip += send->size();
-
-        QString delay = tableData->string(send->delay);
-        if (send->delayexpr != NoEvaluator) {
-            delay = stateMachine->dataModel()->evaluateToString(send->delayexpr, ok);
-            if (!(*ok))
-                return ip;
-        }
-
-        QScxmlEvent *event = QScxmlEventBuilder(stateMachine, *send).buildEvent();
-        if (!event) {
-            *ok = false;
-            return ip;
-        }
-
-        if (!delay.isEmpty()) {
-            int msecs = parseTime(delay);
-            if (msecs >= 0) {
-                event->setDelay(msecs);
-            } else {
-                qCDebug(qscxmlLog) << stateMachine << "failed to parse delay time" << delay;
-                *ok = false;
-                return ip;
-            }
-        }
-
-        stateMachine->submitEvent(event);
-        return ip;
+        const QString delay = tableData->string(send->delay);
+        const int sendOp = addOp(runSend, instr, onFailure, delay);
+        m_ops[size_t(sendOp)].sendInfo = int(m_sends.size());
+        m_sends.push_back(decodeSend(tableData, send, delay));
+        return ip + send->size();
     }
 
     case Instruction::JavaScript: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing script step";
         const JavaScript *javascript = reinterpret_cast<const JavaScript *>(instr);
-        ip += javascript->size();
-        dataModel->evaluateToVoid(javascript->go, ok);
-        return ip;
+        addOp(runJavaScript, instr, onFailure);
+        return ip + javascript->size();
     }
 
     case Instruction::If: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing if step";
+        // The blocks follow the If operation in order, each but the last one ending in a jump
+        // past the others. The conditions map to the first blocks, and an <else> block is the
+        // last one.
         const If *_if = reinterpret_cast<const If *>(instr);
-        ip += _if->size();
-        auto blocks = _if->blocks();
-        for (qint32 i = 0; i < _if->conditions.count; ++i) {
-            bool conditionOk = true;
-            if (dataModel->evaluateToBool(_if->conditions.at(i), &conditionOk) && conditionOk) {
-                const InstructionId *block = blocks->at(i);
-                step(block, ok);
-                qCDebug(qscxmlLog) << stateMachine << "Finished if step";
-                return ip;
-            }
+        const InstructionSequences *blocks = _if->blocks();
+        const int conditionCount = std::min(_if->conditions.count, blocks->sequenceCount);
+        const int ifOp = addOp(runIf, instr, onFailure);
+        m_ops[size_t(ifOp)].firstBranch = int(m_branches.size());
+        m_ops[size_t(ifOp)].branchCount = conditionCount;
+        m_ops[size_t(ifOp)].jump = -1;
+
+        std::vector<int> jumps;
+        const InstructionId *block = reinterpret_cast<const InstructionId *>(blocks->sequences());
+        for (int i = 0; i != blocks->sequenceCount; ++i) {
+            if (i > 0)
+                jumps.push_back(addOp(runJump, nullptr, onFailure));
+            const int target = int(m_ops.size());
+            if (i < conditionCount)
+                m_branches.push_back({ _if->conditions.at(i), target });
+            else
+                m_ops[size_t(ifOp)].jump = target;
+            block = decode(tableData, block, onFailure);
         }
 
-        if (_if->conditions.count < blocks->sequenceCount)
-            step(blocks->at(_if->conditions.count), ok);
-
-        return ip;
+        const int end = int(m_ops.size());
+        for (int jump : jumps)
+            m_ops[size_t(jump)].jump = end;
+        if (m_ops[size_t(ifOp)].jump == -1)
+            m_ops[size_t(ifOp)].jump = end;
+        return ip + _if->size();
     }
 
     case Instruction::Foreach: {
-        class LoopBody: public QScxmlDataModel::ForeachLoopBody // If only we could put std::function in public API, we could use a lambda here. Alas....
-        {
-            QScxmlExecutionEngine *engine;
-            const InstructionId *loopStart;
-
-        public:
-            LoopBody(QScxmlExecutionEngine *engine, const InstructionId *loopStart)
-                : engine(engine)
-                , loopStart(loopStart)
-            {}
-
-            void run(bool *ok) override
-            {
-                engine->step(loopStart, ok);
-            }
-        };
-
-        qCDebug(qscxmlLog) << stateMachine << "Executing foreach step";
+        // The body is run by the data model, and a failure in it ends that run.
         const Foreach *_foreach = reinterpret_cast<const Foreach *>(instr);
-        const InstructionId *loopStart = _foreach->blockstart();
-        ip += _foreach->size();
-        LoopBody body(this, loopStart);
-        dataModel->evaluateForeach(_foreach->doIt, ok, &body);
-        return ip;
+        const int foreachOp = addOp(runForeach, instr, onFailure);
+        decodeSequence(tableData, &_foreach->block, Abort);
+        m_ops[size_t(foreachOp)].jump = int(m_ops.size());
+        return ip + _foreach->size();
     }
 
     case Instruction::Raise: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing raise step";
         const Raise *raise = reinterpret_cast<const Raise *>(instr);
-        ip += raise->size();
-        auto name = tableData->string(raise->event);
-        auto event = new QScxmlEvent;
-        event->setName(name);
-        event->setEventType(QScxmlEvent::InternalEvent);
-        stateMachine->submitEvent(event);
-        return ip;
+        addOp(runRaise, instr, onFailure, tableData->string(raise->event));
+        return ip + raise->size();
     }
 
     case Instruction::Log: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing log step";
         const Log *log = reinterpret_cast<const Log *>(instr);
-        ip += log->size();
-        QString str;
-        if (log->expr != NoEvaluator) {
-            str = dataModel->evaluateToString(log->expr, ok);
-            if (!*ok)
-                qCWarning(qscxmlLog) << stateMachine << "Could not evaluate <log> expr to string.";
-        }
-
-        const QString label = tableData->string(log->label);
-        qCDebug(scxmlLog) << label << ":" << str;
-        QMetaObject::invokeMethod(stateMachine,
-                                  "log",
-                                  Qt::QueuedConnection,
-                                  Q_ARG(QString, label),
-                                  Q_ARG(QString, str));
-        return ip;
+        addOp(runLog, instr, onFailure, tableData->string(log->label));
+        return ip + log->size();
     }
 
     case Instruction::Cancel: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing cancel step";
         const Cancel *cancel = reinterpret_cast<const Cancel *>(instr);
-        ip += cancel->size();
-        QString e = tableData->string(cancel->sendid);
-        if (cancel->sendidexpr != NoEvaluator)
-            e = dataModel->evaluateToString(cancel->sendidexpr, ok);
-        if (*ok && !e.isEmpty())
-            stateMachine->cancelDelayedEvent(e);
-        return ip;
+        addOp(runCancel, instr, onFailure, tableData->string(cancel->sendid));
+        return ip + cancel->size();
     }
 
     case Instruction::Assign: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing assign step";
         const Assign *assign = reinterpret_cast<const Assign *>(instr);
-        ip += assign->size();
-        dataModel->evaluateAssignment(assign->expression, ok);
-        return ip;
+        addOp(runAssign, instr, onFailure);
+        return ip + assign->size();
     }
 
     case Instruction::Initialize: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing initialize step";
         const Initialize *init = reinterpret_cast<const Initialize *>(instr);
-        ip += init->size();
-        dataModel->evaluateInitialization(init->expression, ok);
-        return ip;
+        addOp(runInitialize, instr, onFailure);
+        return ip + init->size();
     }
 
     case Instruction::DoneData: {
-        qCDebug(qscxmlLog) << stateMachine << "Executing DoneData step";
         const DoneData *doneData = reinterpret_cast<const DoneData *>(instr);
-
-        QString eventName = QStringLiteral("done.state.") + extraData.toString();
-        QScxmlEventBuilder event(stateMachine, eventName, doneData);
-        auto e = event();
-        e->setEventType(QScxmlEvent::InternalEvent);
-        qCDebug(qscxmlLog) << stateMachine << "submitting event" << eventName;
-        stateMachine->submitEvent(e);
-        return ip;
+        addOp(runDoneData, instr, onFailure);
+        return ip + sizeof(DoneData) / sizeof(qint32) + doneData->params.dataSize();
     }
 
     default:
+        // Binary tables are checked for unknown instructions when they are loaded.
         Q_UNREACHABLE();
-        *ok = false;
         return ip;
     }
 }
+
+} // QScxmlInternal namespace
+
+QScxmlExecutionEngine::QScxmlExecutionEngine(QScxmlStateMachine *stateMachine)
+    : stateMachine(stateMachine)
+{
+    Q_ASSERT(stateMachine);
+}
+
+bool QScxmlExecutionEngine::execute(ContainerId id, const QVariant &extraData)
+{
+    Q_ASSERT(stateMachine);
+
+    if (id == NoInstruction)
+        return true;
+
+    // The table index has the content of all states and transitions. Anything else is decoded
+    // here the first time it runs.
+    const QScxmlTableData *tableData = stateMachine->tableData();
+    const auto &tableIndex = QScxmlStateMachinePrivate::get(stateMachine)->m_tableIndex;
+    const QScxmlInternal::ExecutableCode *code = tableIndex ? &tableIndex->code() : nullptr;
+    if (!code || !code->contains(id)) {
+        if (localCodeFor != tableData) {
+            localCode.clear();
+            localCodeFor = tableData;
+        }
+        auto &local = localCode[id];
+        if (!local) {
+            local.reset(new QScxmlInternal::ExecutableCode);
+            local->add(tableData, id);
+        }
+        code = local.get();
+    }
+
+    QScxmlInternal::ExecutableCode::Frame frame {
+        stateMachine, stateMachine->dataModel(), &extraData, code
+    };
+    return code->execute(&frame, id);
+}
 #endif // BUILD_QSCXMLC
 
 QT_END_NAMESPACE
@@ -18,8 +18,14 @@
 #include <QtScxml/qscxmlexecutablecontent.h>
 #include <QtScxml/private/qscxmltabledata_p.h>
 #include <QtScxml/private/qscxmlcompiler_p.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qstringlist.h>
 #include <QtCore/qtextstream.h>
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 #ifndef BUILD_QSCXMLC
 #include <QtScxml/qscxmldatamodel.h>
 #include <QtScxml/qscxmlstatemachine.h>
@@ -461,6 +467,112 @@ struct StateTable {
 
 } // QScxmlExecutableContent namespace
 
+class QScxmlDataModel;
+
+namespace QScxmlInternal {
+
+// The parts of a <send> that do not depend on the data model. They are looked up and parsed when
+// decoding, so that sending an event copies nothing out of the table.
+struct SendInfo
+{
+    QString event;
+    QString type;
+    QString target;
+    QString id;
+    QString idLocation;
+    QString content;
+    QString instructionLocation;
+    QStringList namelist;
+    QStringList paramNames;
+    QStringList paramLocations;
+    int delay = 0; // in milliseconds, negative if the delay attribute is not a valid time
+};
+
+// Executable content, decoded into a flat list of operations. Running it needs no recursion over
+// the nested instruction layout: the blocks of an <if> are laid out one after the other and
+// connected by jumps, literal strings are looked up while decoding, and every operation carries
+// the function that runs it.
+class ExecutableCode
+{
+    Q_DISABLE_COPY(ExecutableCode)
+
+public:
+    // The state that all operations of one run share.
+    struct Frame
+    {
+        QScxmlStateMachine *stateMachine;
+        QScxmlDataModel *dataModel;
+        const QVariant *extraData;
+        const ExecutableCode *code;
+    };
+
+    struct Op;
+
+    // Runs the operation at index pc, and returns the index of the operation to run next.
+    typedef int (*Handler)(Frame *frame, const Op &op, int pc, bool *ok);
+
+    // A failing operation continues with onFailure, or ends the run if that is Abort. Failures
+    // propagate up to the innermost InstructionSequences, as they did with the nested layout.
+    enum { Abort = -1, NextSequence = -2 };
+
+    struct Op
+    {
+        Handler handler;
+        const QScxmlExecutableContent::Instruction *instruction;
+        QString string; // the literal operand: delay, event, label or sendid
+        int jump; // the end of a <foreach> or <if>, the <else> block, or the target of a jump
+        int firstBranch; // the conditions of an <if>
+        int branchCount;
+        int sendInfo; // of a <send>
+        int onFailure;
+    };
+
+    struct Branch
+    {
+        QScxmlExecutableContent::EvaluatorId condition;
+        int target;
+    };
+
+    ExecutableCode() = default;
+
+    // Decodes the container, unless that was done before.
+    void add(const QScxmlTableData *tableData, QScxmlExecutableContent::ContainerId id);
+    bool contains(QScxmlExecutableContent::ContainerId id) const
+    { return m_containers.contains(id); }
+
+    // Runs a container that was added before.
+    bool execute(Frame *frame, QScxmlExecutableContent::ContainerId id) const;
+
+    // Runs the operations from first up to, but not including, last.
+    bool run(Frame *frame, int first, int last) const;
+
+    const Branch *branches(const Op &op) const { return m_branches.data() + op.firstBranch; }
+    const SendInfo &sendInfo(const Op &op) const { return m_sends[size_t(op.sendInfo)]; }
+
+private:
+    struct Range
+    {
+        int first = 0;
+        int last = 0;
+    };
+
+    const QScxmlExecutableContent::InstructionId *decode(
+            const QScxmlTableData *tableData, const QScxmlExecutableContent::InstructionId *ip,
+            int onFailure);
+    void decodeSequence(const QScxmlTableData *tableData,
+                        const QScxmlExecutableContent::InstructionSequence *sequence,
+                        int onFailure);
+    int addOp(Handler handler, const QScxmlExecutableContent::Instruction *instruction,
+              int onFailure, const QString &string = QString());
+
+    std::vector<Op> m_ops;
+    std::vector<Branch> m_branches;
+    std::vector<SendInfo> m_sends;
+    QHash<QScxmlExecutableContent::ContainerId, Range> m_containers;
+};
+
+} // QScxmlInternal namespace
+
 class QScxmlExecutionEngine
 {
     Q_DISABLE_COPY(QScxmlExecutionEngine)
@@ -471,11 +583,13 @@ public:
     bool execute(QScxmlExecutableContent::ContainerId ip, const QVariant &extraData = QVariant());
 
 private:
-    const QScxmlExecutableContent::InstructionId *step(
-            const QScxmlExecutableContent::InstructionId *ip, bool *ok);
-
     QScxmlStateMachine *stateMachine;
-    QVariant extraData;
+
+    // Containers that the table index does not decode, as the <finalize> of an <invoke>. Each one
+    // gets its own code, so that running one can add another.
+    std::unordered_map<QScxmlExecutableContent::ContainerId,
+                       std::unique_ptr<QScxmlInternal::ExecutableCode>> localCode;
+    const QScxmlTableData *localCodeFor = nullptr;
 };
 
 QT_END_NAMESPACE
@@ -16,9 +16,11 @@ class QScxmlNullDataModelPrivate : public QScxmlDataModelPrivate
     struct ResolvedEvaluatorInfo {
         bool error;
         QString str;
+        int stateIndex; // of the state named in In(), if there is one
 
         ResolvedEvaluatorInfo()
             : error(false)
+            , stateIndex(QScxmlExecutableContent::StateTable::InvalidIndex)
         {}
     };
 
@@ -28,22 +30,27 @@ public:
         Q_Q(QScxmlNullDataModel);
         Q_ASSERT(ok);
 
-        ResolvedEvaluatorInfo info;
-        Resolved::const_iterator it = resolved.find(id);
-        if (it == resolved.end()) {
-            info = prepare(id);
-        } else {
-            info = it.value();
+        QScxmlStateMachinePrivate *smp = QScxmlStateMachinePrivate::get(q->stateMachine());
+
+        // The resolved state indexes are only valid for the table they were resolved with.
+        if (resolvedFor != smp->m_tableIndex.data()) {
+            resolved.clear();
+            resolvedFor = smp->m_tableIndex.data();
         }
 
+        Resolved::const_iterator it = resolved.constFind(id);
+        if (it == resolved.constEnd())
+            it = resolved.insert(id, prepare(id));
+        const ResolvedEvaluatorInfo &info = it.value();
+
         if (info.error) {
             *ok = false;
-            QScxmlStateMachinePrivate::get(q->stateMachine())->submitError(QStringLiteral("error.execution"), info.str);
+            smp->submitError(QStringLiteral("error.execution"), info.str);
             return false;
         }
 
         *ok = true;
-        return q->stateMachine()->isActive(info.str);
+        return smp->configuration().contains(info.stateIndex);
     }
 
     ResolvedEvaluatorInfo prepare(QScxmlExecutableContent::EvaluatorId id)
@@ -64,6 +71,8 @@ public:
         if (expr.startsWith(QStringLiteral("In(")) && expr.endsWith(QLatin1Char(')'))) {
             resolved.error = false;
             resolved.str =  expr.mid(3, expr.size() - 4);
+            if (resolvedFor)
+                resolved.stateIndex = resolvedFor->stateIndex(resolved.str);
         } else {
             resolved.error = true;
             resolved.str =  QStringLiteral("%1 in %2").arg(expr, td->string(info.context));
@@ -74,6 +83,7 @@ public:
 private:
     typedef QHash<QScxmlExecutableContent::EvaluatorId, ResolvedEvaluatorInfo> Resolved;
     Resolved resolved;
+    const QScxmlInternal::TableIndex *resolvedFor = nullptr;
 };
 
 /*!
@@ -6,7 +6,9 @@
 #include "qscxmlevent_p.h"
 #include "qscxmlinvokableservice.h"
 #include "qscxmldatamodel_p.h"
+#include "qscxmlbinarytable_p.h"
 
+#include <qdeadlinetimer.h>
 #include <qfile.h>
 #include <qhash.h>
 #include <qloggingcategory.h>
@@ -14,13 +16,18 @@
 #include <qtimer.h>
 #include <qthread.h>
 
+#include <algorithm>
 #include <functional>
+#include <limits>
 
 QT_BEGIN_NAMESPACE
 
 Q_LOGGING_CATEGORY(qscxmlLog, "qt.scxml.statemachine")
 Q_LOGGING_CATEGORY(scxmlLog, "scxml.statemachine")
 
+// The data model is handed this event between events, so that resetting it does not create one.
+Q_GLOBAL_STATIC(QScxmlEvent, emptyEvent)
+
 /*!
  * \class QScxmlStateMachine
  * \brief The QScxmlStateMachine class provides an interface to the state machines
@@ -214,28 +221,138 @@ static int signalIndex(const QMetaObject *meta, const QByteArray &signalName)
 
 void EventLoopHook::queueProcessEvents()
 {
-    if (smp->m_isProcessingEvents)
+    // One pending call processes all events submitted until it runs.
+    if (smp->m_isProcessingEvents || m_processEventsQueued)
         return;
 
+    m_processEventsQueued = true;
     QMetaObject::invokeMethod(this, "doProcessEvents", Qt::QueuedConnection);
 }
 
 void EventLoopHook::doProcessEvents()
 {
+    // The events may already have been processed, for example by processUntilStable().
+    if (!m_processEventsQueued)
+        return;
+
+    m_processEventsQueued = false;
+    smp->processEvents();
+}
+
+void EventLoopHook::doSubmitConcurrentEvents()
+{
+    smp->submitConcurrentEvents();
     smp->processEvents();
 }
 
+void EventLoopHook::updateDelayedEventTimer()
+{
+    const DelayedEventQueue &queue = smp->m_delayedEvents;
+    if (queue.isEmpty()) {
+        stopDelayedEventTimer();
+        return;
+    }
+
+    const qint64 deadline = queue.nextDeadline();
+    if (m_delayedEventTimer.isActive() && m_delayedEventTimerDeadline <= deadline)
+        return;
+
+    const qint64 remaining = qMax(deadline - QDeadlineTimer::current().deadline(), qint64(0));
+    m_delayedEventTimer.start(int(qMin(remaining, qint64(std::numeric_limits<int>::max()))),
+                              this);
+    m_delayedEventTimerDeadline = deadline;
+}
+
+void EventLoopHook::stopDelayedEventTimer()
+{
+    m_delayedEventTimer.stop();
+}
+
 void EventLoopHook::timerEvent(QTimerEvent *timerEvent)
 {
-    const int timerId = timerEvent->timerId();
-    for (auto it = smp->m_delayedEvents.begin(), eit = smp->m_delayedEvents.end(); it != eit; ++it) {
-        if (it->first == timerId) {
-            QScxmlEvent *scxmlEvent = it->second;
-            smp->m_delayedEvents.erase(it);
-            smp->routeEvent(scxmlEvent);
-            killTimer(timerId);
-            return;
-        }
+    if (timerEvent->timerId() != m_delayedEventTimer.timerId()) {
+        QObject::timerEvent(timerEvent);
+        return;
+    }
+
+    // The timer may fire a bit early, in which case nothing is routed and it is started again.
+    m_delayedEventTimer.stop();
+    const qint64 now = QDeadlineTimer::current().deadline();
+    DelayedEventQueue &queue = smp->m_delayedEvents;
+    while (!queue.isEmpty() && queue.nextDeadline() <= now)
+        smp->routeEvent(queue.takeNext());
+    updateDelayedEventTimer();
+}
+
+quint64 DelayedEventQueue::schedule(QScxmlEvent *event, qint64 deadline)
+{
+    Q_ASSERT(event);
+
+    const quint64 sequence = m_nextSequence++;
+    m_heap.push_back({ deadline, sequence });
+    std::push_heap(m_heap.begin(), m_heap.end());
+    m_events.insert(sequence, event);
+    // Events without a send ID cannot be cancelled, so they are not indexed.
+    if (!event->sendId().isEmpty())
+        m_sendIds.insert(event->sendId(), sequence);
+    return sequence;
+}
+
+QScxmlEvent *DelayedEventQueue::cancel(const QString &sendId)
+{
+    auto it = m_sendIds.find(sendId);
+    if (it == m_sendIds.end())
+        return nullptr;
+
+    // Send IDs are usually unique, but if not, the earliest submitted event is cancelled.
+    auto earliest = it;
+    for (++it; it != m_sendIds.end() && it.key() == sendId; ++it) {
+        if (it.value() < earliest.value())
+            earliest = it;
+    }
+    QScxmlEvent *event = m_events.take(earliest.value());
+    m_sendIds.erase(earliest);
+    dropStaleEntries();
+    return event;
+}
+
+QScxmlEvent *DelayedEventQueue::takeNext()
+{
+    Q_ASSERT(!isEmpty());
+
+    const quint64 sequence = m_heap.front().sequence;
+    std::pop_heap(m_heap.begin(), m_heap.end());
+    m_heap.pop_back();
+    QScxmlEvent *event = m_events.take(sequence);
+    Q_ASSERT(event);
+    if (!event->sendId().isEmpty())
+        m_sendIds.remove(event->sendId(), sequence);
+    dropStaleEntries();
+    return event;
+}
+
+void DelayedEventQueue::clear()
+{
+    qDeleteAll(m_events);
+    m_events.clear();
+    m_sendIds.clear();
+    m_heap.clear();
+}
+
+void DelayedEventQueue::dropStaleEntries()
+{
+    if (m_heap.size() > 2 * size_t(m_events.size()) + 16) {
+        m_heap.erase(std::remove_if(m_heap.begin(), m_heap.end(), [this](const Entry &entry) {
+            return !m_events.contains(entry.sequence);
+        }), m_heap.end());
+        std::make_heap(m_heap.begin(), m_heap.end());
+        return;
+    }
+
+    // Keep a live entry at the top, so that nextDeadline() is correct.
+    while (!m_heap.empty() && !m_events.contains(m_heap.front().sequence)) {
+        std::pop_heap(m_heap.begin(), m_heap.end());
+        m_heap.pop_back();
     }
 }
 
@@ -421,8 +538,8 @@ void QScxmlStateMachinePrivate::routeEvent(QScxmlEvent *event)
     if (!event)
         return;
 
-    QString origin = event->origin();
-    if (origin == QStringLiteral("#_parent")) {
+    const QScxmlEventPrivate::OriginKind originKind = QScxmlEventPrivate::originKind(event);
+    if (originKind == QScxmlEventPrivate::ParentOrigin) {
         if (auto psm = m_parentStateMachine) {
             qCDebug(qscxmlLog) << q << "routing event" << event->name() << "from" << q->name() << "to parent" << psm->name();
                                  QScxmlStateMachinePrivate::get(psm)->postEvent(event);
@@ -430,8 +547,9 @@ void QScxmlStateMachinePrivate::routeEvent(QScxmlEvent *event)
             qCDebug(qscxmlLog) << this << "is not invoked, so it cannot route a message to #_parent";
             delete event;
         }
-    } else if (origin.startsWith(QStringLiteral("#_")) && origin != QStringLiteral("#_internal")) {
+    } else if (originKind == QScxmlEventPrivate::ChildOrigin) {
         // route to children
+        const QString origin = event->origin();
         auto originId = QStringView{origin}.mid(2);
         for (const auto &invokedService : m_invokedServices) {
             auto service = invokedService.service;
@@ -451,10 +569,16 @@ void QScxmlStateMachinePrivate::routeEvent(QScxmlEvent *event)
 }
 
 void QScxmlStateMachinePrivate::postEvent(QScxmlEvent *event)
+{
+    enqueueEvent(event);
+    m_eventLoopHook.queueProcessEvents();
+}
+
+void QScxmlStateMachinePrivate::enqueueEvent(QScxmlEvent *event)
 {
     Q_Q(QScxmlStateMachine);
 
-    if (!event->name().startsWith(QStringLiteral("done.invoke."))) {
+    if (QScxmlEventPrivate::nameKind(event) != QScxmlEventPrivate::DoneInvokeName) {
         for (int id = 0, end = static_cast<int>(m_invokedServices.size()); id != end; ++id) {
             auto service = m_invokedServices[id].service;
             if (service == nullptr)
@@ -493,8 +617,23 @@ void QScxmlStateMachinePrivate::postEvent(QScxmlEvent *event)
         qCDebug(qscxmlLog) << q << "posting internal event" << event->name();
         m_internalQueue.enqueue(event);
     }
+}
 
-    m_eventLoopHook.queueProcessEvents();
+void QScxmlStateMachinePrivate::submitConcurrentEvents()
+{
+    Q_Q(QScxmlStateMachine);
+
+    // Events for this machine are queued without posting another call to the event loop.
+    m_concurrentEvents.takeAll([this, q](QScxmlEvent *event) {
+        const QScxmlEventPrivate::OriginKind originKind = QScxmlEventPrivate::originKind(event);
+        if (event->delay() > 0 || originKind == QScxmlEventPrivate::ParentOrigin
+                || originKind == QScxmlEventPrivate::ChildOrigin) {
+            q->submitEvent(event);
+        } else {
+            qCDebug(qscxmlLog) << q << "submitting event" << event->name() << "from another thread";
+            enqueueEvent(event);
+        }
+    });
 }
 
 void QScxmlStateMachinePrivate::submitDelayedEvent(QScxmlEvent *event)
@@ -502,19 +641,13 @@ void QScxmlStateMachinePrivate::submitDelayedEvent(QScxmlEvent *event)
     Q_ASSERT(event);
     Q_ASSERT(event->delay() > 0);
 
-    const int timerId = m_eventLoopHook.startTimer(event->delay());
-    if (timerId == 0) {
-        qWarning("QScxmlStateMachinePrivate::submitDelayedEvent: "
-                 "failed to start timer for event '%s' (%p)",
-                 qPrintable(event->name()), event);
-        delete event;
-        return;
-    }
-    m_delayedEvents.push_back(std::make_pair(timerId, event));
+    const qint64 deadline = QDeadlineTimer(event->delay()).deadline();
+    const quint64 sequence = m_delayedEvents.schedule(event, deadline);
+    m_eventLoopHook.updateDelayedEventTimer();
 
     qCDebug(qscxmlLog) << q_func()
                        << ": delayed event" << event->name()
-                       << "(" << event << ") got id:" << timerId;
+                       << "(" << event << ") got id:" << sequence;
 }
 
 /*!
@@ -567,6 +700,7 @@ void QScxmlStateMachinePrivate::processEvents()
         return;
 
     m_isProcessingEvents = true;
+    m_eventLoopHook.discardQueuedProcessEvents();
 
     Q_Q(QScxmlStateMachine);
     qCDebug(qscxmlLog) << q_func() << "starting macrostep";
@@ -579,16 +713,15 @@ void QScxmlStateMachinePrivate::processEvents()
             continue;
         }
 
-        OrderedSet enabledTransitions;
-        std::vector<int> configurationInDocumentOrder = m_configuration.list();
-        std::sort(configurationInDocumentOrder.begin(), configurationInDocumentOrder.end());
-        selectTransitions(enabledTransitions, configurationInDocumentOrder, nullptr);
+        OrderedSet &enabledTransitions = m_scratch.enabledTransitions;
+        enabledTransitions.clear();
+        selectTransitions(enabledTransitions, nullptr);
         if (!enabledTransitions.isEmpty()) {
             microstep(enabledTransitions);
         } else if (!m_internalQueue.isEmpty()) {
             auto event = m_internalQueue.dequeue();
             setEvent(event);
-            selectTransitions(enabledTransitions, configurationInDocumentOrder, event);
+            selectTransitions(enabledTransitions, event);
             if (!enabledTransitions.isEmpty()) {
                 microstep(enabledTransitions);
             }
@@ -597,7 +730,7 @@ void QScxmlStateMachinePrivate::processEvents()
         } else if (!m_externalQueue.isEmpty()) {
             auto event = m_externalQueue.dequeue();
             setEvent(event);
-            selectTransitions(enabledTransitions, configurationInDocumentOrder, event);
+            selectTransitions(enabledTransitions, event);
             if (!enabledTransitions.isEmpty()) {
                 microstep(enabledTransitions);
             }
@@ -635,14 +768,14 @@ void QScxmlStateMachinePrivate::setEvent(QScxmlEvent *event)
 
 void QScxmlStateMachinePrivate::resetEvent()
 {
-    m_dataModel.value()->setScxmlEvent(QScxmlEvent());
+    m_dataModel.value()->setScxmlEvent(*emptyEvent());
 }
 
 void QScxmlStateMachinePrivate::emitStateActive(int stateIndex, bool active)
 {
     Q_Q(QScxmlStateMachine);
     void *args[] = { nullptr, const_cast<void*>(reinterpret_cast<const void*>(&active)) };
-    const int signalIndex = m_stateIndexToSignalIndex.value(stateIndex, -1);
+    const int signalIndex = m_tableIndex->signalIndex(stateIndex);
     if (signalIndex >= 0)
         QMetaObject::activate(q, m_metaObject, signalIndex, args);
 }
@@ -671,31 +804,11 @@ void QScxmlStateMachinePrivate::attach(QScxmlStateMachineInfo *info)
 
 void QScxmlStateMachinePrivate::updateMetaCache()
 {
-    // This function creates a mapping from state index/name to their signal indexes.
-    // The state index may differ from its signal index as we don't generate history
-    // and invalid states, effectively skipping them
-    m_stateIndexToSignalIndex.clear();
-    m_stateNameToSignalIndex.clear();
-
-    const QScxmlTableData *tableData = m_tableData.valueBypassingBindings();
-    if (!tableData)
-        return;
-
-    if (!m_stateTable)
-        return;
-
-    int signalIndex = 0;
-    const int methodOffset = QMetaObjectPrivate::signalOffset(m_metaObject);
-    for (int i = 0; i < m_stateTable->stateCount; ++i) {
-        const auto &s = m_stateTable->state(i);
-        if (!s.isHistoryState() && s.type != StateTable::State::Invalid) {
-            m_stateIndexToSignalIndex.insert(i, signalIndex);
-            m_stateNameToSignalIndex.insert(tableData->string(s.name),
-                                            signalIndex + methodOffset);
-
-            ++signalIndex;
-        }
-    }
+    // The mapping from state index/name to their signal indexes is shared by all state
+    // machines with the same table, and kept in the table index. The state index may differ
+    // from its signal index as we don't generate history and invalid states, effectively
+    // skipping them. Only the offset of the state signals in the meta object is per instance.
+    m_stateSignalOffset = QMetaObjectPrivate::signalOffset(m_metaObject);
 }
 
 QStringList QScxmlStateMachinePrivate::stateNames(const std::vector<int> &stateIndexes) const
@@ -706,25 +819,11 @@ QStringList QScxmlStateMachinePrivate::stateNames(const std::vector<int> &stateI
     return names;
 }
 
-std::vector<int> QScxmlStateMachinePrivate::historyStates(int stateIdx) const {
-    const StateTable::Array kids = m_stateTable->array(m_stateTable->state(stateIdx).childStates);
-    std::vector<int> res;
-    if (!kids.isValid()) return res;
-    for (int k : kids) {
-        if (m_stateTable->state(k).isHistoryState())
-            res.push_back(k);
-    }
-    return res;
-}
-
 void QScxmlStateMachinePrivate::exitInterpreter()
 {
     qCDebug(qscxmlLog) << q_func() << "exiting SCXML processing";
 
-    for (auto it : m_delayedEvents) {
-        m_eventLoopHook.killTimer(it.first);
-        delete it.second;
-    }
+    m_eventLoopHook.stopDelayedEventTimer();
     m_delayedEvents.clear();
 
     auto statesToExitSorted = m_configuration.list();
@@ -754,34 +853,7 @@ void QScxmlStateMachinePrivate::returnDoneEvent(QScxmlExecutableContent::Contain
     }
 }
 
-bool QScxmlStateMachinePrivate::nameMatch(const StateTable::Array &patterns,
-                                          QScxmlEvent *event) const
-{
-    const QString eventName = event->name();
-    bool selected = false;
-    for (int eventSelectorIter = 0; eventSelectorIter < patterns.size(); ++eventSelectorIter) {
-        QString eventStr = m_tableData.value()->string(patterns[eventSelectorIter]);
-        if (eventStr == QStringLiteral("*")) {
-            selected = true;
-            break;
-        }
-        if (eventStr.endsWith(QStringLiteral(".*")))
-            eventStr.chop(2);
-        if (eventName.startsWith(eventStr)) {
-            QChar nextC = QLatin1Char('.');
-            if (eventName.size() > eventStr.size())
-                nextC = eventName.at(eventStr.size());
-            if (nextC == QLatin1Char('.') || nextC == QLatin1Char('(')) {
-                selected = true;
-                break;
-            }
-        }
-    }
-    return selected;
-}
-
 void QScxmlStateMachinePrivate::selectTransitions(OrderedSet &enabledTransitions,
-                                                  const std::vector<int> &configInDocumentOrder,
                                                   QScxmlEvent *event) const
 {
     if (event == nullptr) {
@@ -791,61 +863,49 @@ void QScxmlStateMachinePrivate::selectTransitions(OrderedSet &enabledTransitions
                            << QScxmlEventPrivate::debugString(event).constData();
     }
 
-    std::vector<int> states;
-    states.reserve(16);
-    for (int configStateIdx : configInDocumentOrder) {
-        if (m_stateTable->state(configStateIdx).isAtomic()) {
-            states.clear();
-            states.push_back(configStateIdx);
-            getProperAncestors(&states, configStateIdx, -1);
-            for (int stateIdx : states) {
-                bool finishedWithThisConfigState  = false;
-
-                if (stateIdx == -1) {
-                    // the state machine has no transitions (other than the initial one, which has
-                    // already been taken at this point)
-                    continue;
-                }
-                const auto &state = m_stateTable->state(stateIdx);
-                const StateTable::Array transitions = m_stateTable->array(state.transitions);
-                if (!transitions.isValid())
-                    continue;
-                std::vector<int> sortedTransitions(transitions.size(), -1);
-                std::copy(transitions.begin(), transitions.end(), sortedTransitions.begin());
-                for (int transitionIndex : sortedTransitions) {
-                    const StateTable::Transition &t = m_stateTable->transition(transitionIndex);
-                    bool enabled = false;
-                    if (event == nullptr) {
-                        if (t.events == -1) {
-                            if (t.condition == -1) {
-                                enabled = true;
-                            } else {
-                                bool ok = false;
-                                enabled = m_dataModel.value()->evaluateToBool(t.condition, &ok) && ok;
-                            }
-                        }
-                    } else {
-                        if (t.events != -1 && nameMatch(m_stateTable->array(t.events), event)) {
-                            if (t.condition == -1) {
-                                enabled = true;
-                            } else {
-                                bool ok = false;
-                                enabled = m_dataModel.value()->evaluateToBool(t.condition, &ok) && ok;
-                            }
-                        }
-                    }
-                    if (enabled) {
-                        enabledTransitions.add(transitionIndex);
-                        finishedWithThisConfigState = true;
-                        break; // stop iterating over transitions
-                    }
-                }
-
-                if (finishedWithThisConfigState)
-                    break; // stop iterating over ancestors
+    std::vector<int> &eventPrefixIds = m_scratch.eventPrefixIds;
+    std::vector<int> &candidates = m_scratch.candidates;
+    if (event != nullptr)
+        m_tableIndex->eventPrefixes(event->name(), &eventPrefixIds);
+
+    // Adds the first enabled transition of the state, and returns whether there was one.
+    const auto selectTransition = [&](int stateIdx) {
+        // Only look at the transitions that can match the event, or at the eventless ones if
+        // there is no event.
+        QScxmlInternal::TableIndex::IndexRange transitions;
+        if (event == nullptr) {
+            transitions = m_tableIndex->eventlessTransitions(stateIdx);
+        } else {
+            m_tableIndex->eventTransitions(stateIdx, eventPrefixIds, &candidates);
+            transitions = { candidates.data(), candidates.data() + candidates.size() };
+        }
+        for (int transitionIndex : transitions) {
+            const StateTable::Transition &t = m_stateTable->transition(transitionIndex);
+            bool enabled = false;
+            if (t.condition == -1) {
+                enabled = true;
+            } else {
+                bool ok = false;
+                enabled = m_dataModel.value()->evaluateToBool(t.condition, &ok) && ok;
+            }
+            if (enabled) {
+                enabledTransitions.add(transitionIndex);
+                return true;
             }
         }
-    }
+        return false;
+    };
+
+    m_configuration.forEachInDocumentOrder([&](int configStateIdx) {
+        if (!m_stateTable->state(configStateIdx).isAtomic())
+            return;
+        if (selectTransition(configStateIdx))
+            return;
+        for (int ancestorIdx : m_tableIndex->properAncestors(configStateIdx)) {
+            if (selectTransition(ancestorIdx))
+                return;
+        }
+    });
     if (!enabledTransitions.isEmpty())
         removeConflictingTransitions(&enabledTransitions);
 }
@@ -854,18 +914,9 @@ void QScxmlStateMachinePrivate::removeConflictingTransitions(OrderedSet *enabled
 {
     Q_ASSERT(enabledTransitions);
 
-    auto sortedTransitions = enabledTransitions->takeList();
+    std::vector<int> &sortedTransitions = m_scratch.sortedTransitions;
+    enabledTransitions->takeList(&sortedTransitions);
     std::sort(sortedTransitions.begin(), sortedTransitions.end(), [this](int t1, int t2) -> bool {
-        auto descendantDepth = [this](int state, int ancestor)->int {
-            int depth = 0;
-            for (int it = state; it != -1; it = m_stateTable->state(it).parent) {
-                if (it == ancestor)
-                    break;
-                ++depth;
-            }
-            return depth;
-        };
-
         const auto &s1 = m_stateTable->transition(t1).source;
         const auto &s2 = m_stateTable->transition(t2).source;
         if (s1 == s2) {
@@ -875,9 +926,10 @@ void QScxmlStateMachinePrivate::removeConflictingTransitions(OrderedSet *enabled
         } else if (isDescendant(s2, s1)) {
             return false;
         } else {
-            const int lcca = findLCCA({ s1, s2 });
-            const int s1Depth = descendantDepth(s1, lcca);
-            const int s2Depth = descendantDepth(s2, lcca);
+            // The depth below the common ancestor of both sources compares the same as the depth
+            // below the root.
+            const int s1Depth = m_tableIndex->level(s1);
+            const int s2Depth = m_tableIndex->level(s2);
             if (s1Depth == s2Depth)
                 return s1 < s2;
             else
@@ -885,17 +937,24 @@ void QScxmlStateMachinePrivate::removeConflictingTransitions(OrderedSet *enabled
         }
     });
 
-    OrderedSet filteredTransitions;
+    OrderedSet &filteredTransitions = m_scratch.filteredTransitions;
+    OrderedSet &transitionsToRemove = m_scratch.transitionsToRemove;
+    filteredTransitions.clear();
     for (int t1 : sortedTransitions) {
-        OrderedSet transitionsToRemove;
+        transitionsToRemove.clear();
         bool t1Preempted = false;
-        OrderedSet exitSetT1;
-        computeExitSet({t1}, exitSetT1);
-        const int source1 = m_stateTable->transition(t1).source;
+        const auto &transition1 = m_stateTable->transition(t1);
+        const int source1 = transition1.source;
+        if (transition1.targets == StateTable::InvalidIndex) {
+            // a targetless transition has no exit set, so it cannot conflict with anything
+            filteredTransitions.add(t1);
+            continue;
+        }
+        const int domain1 = getTransitionDomain(t1);
         for (int t2 : filteredTransitions) {
-            OrderedSet exitSetT2;
-            computeExitSet({t2}, exitSetT2);
-            if (exitSetT1.intersectsWith(exitSetT2)) {
+            if (m_stateTable->transition(t2).targets == StateTable::InvalidIndex)
+                continue;
+            if (exitSetsIntersect(domain1, getTransitionDomain(t2))) {
                 const int source2 = m_stateTable->transition(t2).source;
                 if (isDescendant(source1, source2)) {
                     transitionsToRemove.add(t2);
@@ -912,26 +971,24 @@ void QScxmlStateMachinePrivate::removeConflictingTransitions(OrderedSet *enabled
             filteredTransitions.add(t1);
         }
     }
-    *enabledTransitions = filteredTransitions;
+    std::swap(*enabledTransitions, filteredTransitions);
 }
 
-void QScxmlStateMachinePrivate::getProperAncestors(std::vector<int> *ancestors, int state1,
-                                                   int state2) const
+// The exit set of a transition consists of the active states below its domain. The exit sets of
+// two transitions can therefore only intersect if one of the domains contains the other, and
+// then only if an active state is below the inner one.
+bool QScxmlStateMachinePrivate::exitSetsIntersect(int domain1, int domain2) const
 {
-    Q_ASSERT(ancestors);
-
-    if (state1 == -1) {
-        return;
-    }
-
-    int parent = state1;
-    do {
-        parent = m_stateTable->state(parent).parent;
-        if (parent == state2) {
-            break;
+    int innerDomain = domain1;
+    if (domain1 != domain2) {
+        if (domain2 != StateTable::InvalidIndex
+                && (domain1 == StateTable::InvalidIndex || isDescendant(domain2, domain1))) {
+            innerDomain = domain2;
+        } else if (domain1 == StateTable::InvalidIndex || !isDescendant(domain1, domain2)) {
+            return false;
         }
-        ancestors->push_back(parent);
-    } while (parent != -1);
+    }
+    return hasDescendant(m_configuration, innerDomain);
 }
 
 void QScxmlStateMachinePrivate::microstep(const OrderedSet &enabledTransitions)
@@ -968,10 +1025,12 @@ void QScxmlStateMachinePrivate::microstep(const OrderedSet &enabledTransitions)
 
 void QScxmlStateMachinePrivate::exitStates(const OrderedSet &enabledTransitions)
 {
-    OrderedSet statesToExit;
+    OrderedSet &statesToExit = m_scratch.statesToExit;
+    statesToExit.clear();
     computeExitSet(enabledTransitions, statesToExit);
-    auto statesToExitSorted = statesToExit.takeList();
-    std::sort(statesToExitSorted.begin(), statesToExitSorted.end(), std::greater<int>());
+    std::vector<int> &statesToExitSorted = m_scratch.sortedStatesToExit;
+    statesToExit.takeSortedList(&statesToExitSorted);
+    std::reverse(statesToExitSorted.begin(), statesToExitSorted.end());
     qCDebug(qscxmlLog) << q_func() << "exiting states" << stateNames(statesToExitSorted);
     for (int s : statesToExitSorted) {
         const auto &state = m_stateTable->state(s);
@@ -979,9 +1038,17 @@ void QScxmlStateMachinePrivate::exitStates(const OrderedSet &enabledTransitions)
             m_statesToInvoke.remove(s);
     }
     for (int s : statesToExitSorted) {
-        for (int h : historyStates(s)) {
+        const StateTable::Array kids = m_stateTable->array(m_stateTable->state(s).childStates);
+        if (!kids.isValid())
+            continue;
+        for (int h : kids) {
             const auto &hState = m_stateTable->state(h);
-            QList<int> history;
+            if (!hState.isHistoryState())
+                continue;
+
+            // Reuse the list recorded the previous time the state was exited.
+            QList<int> &history = m_historyValue[h];
+            history.clear();
 
             for (int s0 : m_configuration) {
                 const auto &s0State = m_stateTable->state(s0);
@@ -993,8 +1060,6 @@ void QScxmlStateMachinePrivate::exitStates(const OrderedSet &enabledTransitions)
                         history.append(s0);
                 }
             }
-
-            m_historyValue[h] = history;
         }
     }
     for (int s : statesToExitSorted) {
@@ -1049,12 +1114,16 @@ void QScxmlStateMachinePrivate::enterStates(const OrderedSet &enabledTransitions
 {
     Q_Q(QScxmlStateMachine);
 
-    OrderedSet statesToEnter, statesForDefaultEntry;
-    HistoryContent defaultHistoryContent;
+    OrderedSet &statesToEnter = m_scratch.statesToEnter;
+    OrderedSet &statesForDefaultEntry = m_scratch.statesForDefaultEntry;
+    HistoryContent &defaultHistoryContent = m_scratch.defaultHistoryContent;
+    statesToEnter.clear();
+    statesForDefaultEntry.clear();
+    defaultHistoryContent.clear();
     computeEntrySet(enabledTransitions, &statesToEnter, &statesForDefaultEntry,
                     &defaultHistoryContent);
-    auto sortedStates = statesToEnter.takeList();
-    std::sort(sortedStates.begin(), sortedStates.end());
+    std::vector<int> &sortedStates = m_scratch.sortedStatesToEnter;
+    statesToEnter.takeSortedList(&sortedStates);
     qCDebug(qscxmlLog) << q_func() << "entering states" << stateNames(sortedStates);
     for (int s : sortedStates) {
         const auto &state = m_stateTable->state(s);
@@ -1126,8 +1195,17 @@ void QScxmlStateMachinePrivate::computeEntrySet(const OrderedSet &enabledTransit
         for (int s : m_stateTable->array(transition.targets))
             addDescendantStatesToEnter(s, statesToEnter, statesForDefaultEntry,
                                        defaultHistoryContent);
+        const int staticDomain = m_tableIndex->transitionDomain(t);
+        if (staticDomain != QScxmlInternal::TableIndex::DynamicDomain) {
+            // no history states among the targets, so they are the effective targets
+            for (int s : m_stateTable->array(transition.targets))
+                addAncestorStatesToEnter(s, staticDomain, statesToEnter, statesForDefaultEntry,
+                                         defaultHistoryContent);
+            continue;
+        }
         auto ancestor = getTransitionDomain(t);
-        OrderedSet targets;
+        OrderedSet &targets = m_scratch.entryTargets;
+        targets.clear();
         getEffectiveTargetStates(&targets, t);
         for (auto s : targets)
             addAncestorStatesToEnter(s, ancestor, statesToEnter, statesForDefaultEntry,
@@ -1165,8 +1243,8 @@ void QScxmlStateMachinePrivate::addDescendantStatesToEnter(
                 transitionIdx = m_stateTable->array(state.transitions)[0];
             }
             const auto &defaultHistoryTransition = m_stateTable->transition(transitionIdx);
-            defaultHistoryContent->operator[](state.parent) =
-                    defaultHistoryTransition.transitionInstructions;
+            defaultHistoryContent->set(state.parent,
+                                       defaultHistoryTransition.transitionInstructions);
             StateTable::Array targetStates = m_stateTable->array(defaultHistoryTransition.targets);
             for (int s : targetStates)
                 addDescendantStatesToEnter(s, statesToEnter, statesForDefaultEntry,
@@ -1191,11 +1269,11 @@ void QScxmlStateMachinePrivate::addDescendantStatesToEnter(
             }
         } else {
             if (state.isParallel()) {
-                for (int child : getChildStates(state)) {
+                forEachChildState(state, [&](int child) {
                     if (!hasDescendant(*statesToEnter, child))
                         addDescendantStatesToEnter(child, statesToEnter, statesForDefaultEntry,
                                                    defaultHistoryContent);
-                }
+                });
             }
         }
     }
@@ -1209,21 +1287,17 @@ void QScxmlStateMachinePrivate::addAncestorStatesToEnter(
     Q_ASSERT(statesForDefaultEntry);
     Q_ASSERT(defaultHistoryContent);
 
-    std::vector<int> ancestors;
-    getProperAncestors(&ancestors, stateIndex, ancestorIndex);
-    for (int anc : ancestors) {
-        if (anc == -1) {
-            // we can't enter the state machine itself, so:
-            continue;
-        }
+    for (int anc : m_tableIndex->properAncestors(stateIndex)) {
+        if (anc == ancestorIndex)
+            break;
         statesToEnter->add(anc);
         const auto &ancState = m_stateTable->state(anc);
         if (ancState.isParallel()) {
-            for (int child : getChildStates(ancState)) {
+            forEachChildState(ancState, [&](int child) {
                 if (!hasDescendant(*statesToEnter, child))
                     addDescendantStatesToEnter(child, statesToEnter, statesForDefaultEntry,
                                                defaultHistoryContent);
-            }
+            });
         }
     }
 }
@@ -1232,21 +1306,7 @@ std::vector<int> QScxmlStateMachinePrivate::getChildStates(
         const QScxmlExecutableContent::StateTable::State &state) const
 {
     std::vector<int> childStates;
-    auto kids = m_stateTable->array(state.childStates);
-    if (kids.isValid()) {
-        childStates.reserve(kids.size());
-        for (int kiddo : kids) {
-            switch (m_stateTable->state(kiddo).type) {
-            case StateTable::State::Normal:
-            case StateTable::State::Final:
-            case StateTable::State::Parallel:
-                childStates.push_back(kiddo);
-                break;
-            default:
-                break;
-            }
-        }
-    }
+    forEachChildState(state, [&childStates](int child) { childStates.push_back(child); });
     return childStates;
 }
 
@@ -1270,13 +1330,7 @@ bool QScxmlStateMachinePrivate::allDescendants(const OrderedSet &statesToEnter,
 
 bool QScxmlStateMachinePrivate::isDescendant(int state1, int state2) const
 {
-    int parent = state1;
-    do {
-        parent = m_stateTable->state(parent).parent;
-        if (parent == state2)
-            return true;
-    } while (parent != -1);
-    return false;
+    return m_tableIndex->isDescendant(state1, state2);
 }
 
 bool QScxmlStateMachinePrivate::allInFinalStates(const std::vector<int> &states) const
@@ -1320,7 +1374,12 @@ int QScxmlStateMachinePrivate::getTransitionDomain(int transitionIndex) const
         //oooh, we have the initial transition of the state machine.
         return -1;
 
-    OrderedSet tstates;
+    const int staticDomain = m_tableIndex->transitionDomain(transitionIndex);
+    if (staticDomain != QScxmlInternal::TableIndex::DynamicDomain)
+        return staticDomain;
+
+    OrderedSet &tstates = m_scratch.domainTargets;
+    tstates.clear();
     getEffectiveTargetStates(&tstates, transitionIndex);
     if (tstates.isEmpty()) {
         return StateTable::InvalidIndex;
@@ -1331,28 +1390,19 @@ int QScxmlStateMachinePrivate::getTransitionDomain(int transitionIndex) const
                 && allDescendants(tstates, transition.source)) {
             return transition.source;
         } else {
-            tstates.add(transition.source);
-            return findLCCA(std::move(tstates));
+            return findLCCA(transition.source, tstates);
         }
     }
 }
 
-int QScxmlStateMachinePrivate::findLCCA(OrderedSet &&states) const
+// Returns the least common compound ancestor of the source and the (non-empty) targets.
+int QScxmlStateMachinePrivate::findLCCA(int source, const OrderedSet &targets) const
 {
-    std::vector<int> ancestors;
-    const int head = *states.begin();
-    OrderedSet tail(std::move(states));
-    tail.removeHead();
-
-    getProperAncestors(&ancestors, head, StateTable::InvalidIndex);
-    for (int anc : ancestors) {
-        if (anc != -1) { // the state machine itself is always compound
-            const auto &ancState = m_stateTable->state(anc);
-            if (!ancState.isCompound())
-                continue;
-        }
+    for (int anc : m_tableIndex->properAncestors(*targets.begin())) {
+        if (!m_stateTable->state(anc).isCompound())
+            continue;
 
-        if (allDescendants(tail, anc))
+        if (isDescendant(source, anc) && allDescendants(targets, anc))
             return anc;
     }
 
@@ -1389,6 +1439,11 @@ void QScxmlStateMachinePrivate::getEffectiveTargetStates(OrderedSet *targets,
  * the state machine cannot be started. The errors can be retrieved by calling the parseErrors()
  * method.
  *
+ * Since Qt 6.10, \a fileName can also be a binary state table generated by \c qscxmlc with the
+ * \c --binary option. Such a table is used in place instead of being parsed and compiled, which
+ * makes creating the state machine much faster. Binary tables can only be loaded by the version
+ * of Qt SCXML that generated them.
+ *
  * \sa parseErrors()
  */
 QScxmlStateMachine *QScxmlStateMachine::fromFile(const QString &fileName)
@@ -1401,6 +1456,19 @@ QScxmlStateMachine *QScxmlStateMachine::fromFile(const QString &fileName)
         return stateMachine;
     }
 
+    const QByteArray start = scxmlFile.peek(sizeof(QScxmlInternal::BinaryTable::Magic));
+    if (QScxmlInternal::BinaryTable::hasMagic(start)) {
+        scxmlFile.close();
+        auto stateMachine = QScxmlCompilerPrivate::instantiateBinaryTable(fileName);
+        if (stateMachine == nullptr) {
+            stateMachine = new QScxmlStateMachine(&QScxmlStateMachine::staticMetaObject);
+            QScxmlError err(fileName, 0, 0,
+                            QStringLiteral("invalid or incompatible binary state table"));
+            QScxmlStateMachinePrivate::get(stateMachine)->parserData()->m_errors.append(err);
+        }
+        return stateMachine;
+    }
+
     QScxmlStateMachine *stateMachine = fromData(&scxmlFile, fileName);
     scxmlFile.close();
     return stateMachine;
@@ -1417,10 +1485,7 @@ QScxmlStateMachine *QScxmlStateMachine::fromFile(const QString &fileName)
  */
 QScxmlStateMachine *QScxmlStateMachine::fromData(QIODevice *data, const QString &fileName)
 {
-    QXmlStreamReader xmlReader(data);
-    QScxmlCompiler compiler(&xmlReader);
-    compiler.setFileName(fileName);
-    return compiler.compile();
+    return QScxmlCompilerPrivate::compileShared(data->readAll(), fileName);
 }
 
 QList<QScxmlError> QScxmlStateMachine::parseErrors() const
@@ -1718,6 +1783,8 @@ void QScxmlStateMachine::setTableData(QScxmlTableData *tableData)
     if (tableData) {
         d->m_stateTable = reinterpret_cast<const QScxmlExecutableContent::StateTable *>(
                     tableData->stateMachineTable());
+        d->m_configuration.reserve(d->m_stateTable->stateCount);
+        d->m_scratch.reserve(d->m_stateTable->stateCount, d->m_stateTable->transitionCount);
         // cannot use objectName() here, because it creates binding loop
         const QString currentObjectName = d->extraData
                 ? d->extraData->objectName.valueBypassingBindings() : QString();
@@ -1737,6 +1804,9 @@ void QScxmlStateMachine::setTableData(QScxmlTableData *tableData)
         Q_ASSERT(tableData->stateMachineTable()[d->m_stateTable->arrayOffset +
                                                 d->m_stateTable->arraySize]
                 == QScxmlExecutableContent::StateTable::terminator);
+        d->m_tableIndex = QScxmlInternal::TableIndex::get(tableData);
+    } else {
+        d->m_tableIndex.reset();
     }
 
     d->updateMetaCache();
@@ -1837,13 +1907,9 @@ bool QScxmlStateMachine::isActive(const QString &scxmlStateName) const
 {
     Q_D(const QScxmlStateMachine);
 
-    for (int stateIndex : d->m_configuration) {
-        const auto &state = d->m_stateTable->state(stateIndex);
-        if (d->m_tableData.value()->string(state.name) == scxmlStateName)
-            return true;
-    }
-
-    return false;
+    if (!d->m_tableIndex)
+        return false;
+    return d->m_configuration.contains(d->m_tableIndex->stateIndex(scxmlStateName));
 }
 
 QMetaObject::Connection QScxmlStateMachine::connectToStateImpl(const QString &scxmlStateName,
@@ -1855,7 +1921,12 @@ QMetaObject::Connection QScxmlStateMachine::connectToStateImpl(const QString &sc
     const int *types = metaTypeIds;
 
     Q_D(QScxmlStateMachine);
-    const int signalIndex = d->m_stateNameToSignalIndex.value(scxmlStateName, -1);
+    int signalIndex = -1;
+    if (d->m_tableIndex) {
+        signalIndex = d->m_tableIndex->signalIndex(d->m_tableIndex->stateIndex(scxmlStateName));
+        if (signalIndex >= 0)
+            signalIndex += d->m_stateSignalOffset;
+    }
     return signalIndex < 0 ? QMetaObject::Connection()
                            : QObjectPrivate::connectImpl(this, signalIndex, receiver, slot, slotObj,
                                                          type, types, d->m_metaObject);
@@ -2081,6 +2152,90 @@ void QScxmlStateMachine::submitEvent(const QString &eventName, const QVariant &d
     submitEvent(e);
 }
 
+/*!
+ * \fn template <typename Payload> void QScxmlStateMachine::submitEvent(const QString &eventName, const Payload &payload)
+ * \since 6.10
+ *
+ * A utility method to create and submit an external event with the specified \a eventName as
+ * the name, and \a payload, stored with QVariant::fromValue(), as the payload data. This overload
+ * takes part in overload resolution only for types that cannot be converted to QVariant.
+ *
+ * A QScxmlCppDataModel can read the payload with QScxmlCppDataModel::eventPayload(), without
+ * converting it.
+ */
+
+/*!
+ * \since 6.10
+ *
+ * Submits the SCXML event \a event to this state machine from any thread.
+ *
+ * The event is queued without locking, and picked up by the thread of the state machine once
+ * control returns to its event loop. All events queued until then are submitted together, in
+ * the order they were queued, and processed right away, so that the event loop of the state
+ * machine is woken up only once for them.
+ *
+ * The state machine takes ownership of \a event. The state machine must not be destroyed while
+ * other threads can still call this function.
+ *
+ * \note This function is thread-safe.
+ *
+ * \sa submitEvent()
+ */
+void QScxmlStateMachine::submitEventFromAnyThread(QScxmlEvent *event)
+{
+    Q_D(QScxmlStateMachine);
+
+    if (!event)
+        return;
+
+    if (d->m_concurrentEvents.push(event)) {
+        QMetaObject::invokeMethod(&d->m_eventLoopHook, "doSubmitConcurrentEvents",
+                                  Qt::QueuedConnection);
+    }
+}
+
+/*!
+ * \since 6.10
+ *
+ * Submits all SCXML events in \a events, in order, as if submitEvent() was called for each of
+ * them. The events are processed together once control returns to the event loop, or when
+ * processUntilStable() is called.
+ *
+ * The state machine takes ownership of the events.
+ *
+ * \sa submitEvent(), processUntilStable()
+ */
+void QScxmlStateMachine::submitEvents(QSpan<QScxmlEvent * const> events)
+{
+    for (QScxmlEvent *event : events)
+        submitEvent(event);
+}
+
+/*!
+ * \since 6.10
+ *
+ * Processes all pending events right away, instead of when control returns to the event loop.
+ * Events submitted with submitEventFromAnyThread() that have not been picked up yet are
+ * submitted first. When this function returns, the internal and external event queues are
+ * empty, and reachedStableState() has been emitted once.
+ *
+ * Delayed events that are not due yet stay pending. This function does nothing if the state
+ * machine is not running, or if it is called while the state machine is processing events,
+ * for example from a slot connected to one of its signals.
+ *
+ * \sa submitEvents(), reachedStableState()
+ */
+void QScxmlStateMachine::processUntilStable()
+{
+    Q_D(QScxmlStateMachine);
+
+    if (d->m_isProcessingEvents)
+        return;
+
+    d->submitConcurrentEvents();
+    d->processEvents();
+}
+
 /*!
     \qmlmethod ScxmlStateMachine::cancelDelayedEvent(string sendId)
 
@@ -2094,16 +2249,11 @@ void QScxmlStateMachine::cancelDelayedEvent(const QString &sendId)
 {
     Q_D(QScxmlStateMachine);
 
-    for (auto it = d->m_delayedEvents.begin(), eit = d->m_delayedEvents.end(); it != eit; ++it) {
-        if (it->second->sendId() == sendId) {
-            qCDebug(qscxmlLog) << this
-                               << "canceling event" << sendId
-                               << "with timer id" << it->first;
-            d->m_eventLoopHook.killTimer(it->first);
-            delete it->second;
-            d->m_delayedEvents.erase(it);
-            return;
-        }
+    // The timer is left running. If the cancelled event was the next one due, the timer fires
+    // without routing anything, and is started again for the event that is due then.
+    if (QScxmlEvent *event = d->m_delayedEvents.cancel(sendId)) {
+        qCDebug(qscxmlLog) << this << "canceling event" << sendId;
+        delete event;
     }
 }
 
@@ -2320,8 +2470,9 @@ bool QScxmlStateMachine::isActive(int stateIndex) const
     // Here we need to find the actual internal state index that corresponds with the
     // index of the compiled metaobject (which is same as its mapped signal index).
     // See updateMetaCache()
-    const int mappedStateIndex = d->m_stateIndexToSignalIndex.key(stateIndex, -1);
-    return d->m_configuration.contains(mappedStateIndex);
+    if (!d->m_tableIndex)
+        return false;
+    return d->m_configuration.contains(d->m_tableIndex->signalStateIndex(stateIndex));
 }
 
 QT_END_NAMESPACE
@@ -12,6 +12,7 @@
 
 #include <QtCore/qlist.h>
 #include <QtCore/qpointer.h>
+#include <QtCore/qspan.h>
 #include <QtCore/qstring.h>
 #include <QtCore/qurl.h>
 #include <QtCore/qvariant.h>
@@ -240,6 +241,15 @@ public:
     Q_INVOKABLE void submitEvent(QScxmlEvent *event);
     Q_INVOKABLE void submitEvent(const QString &eventName);
     Q_INVOKABLE void submitEvent(const QString &eventName, const QVariant &data);
+    template <typename Payload,
+              std::enable_if_t<!std::is_convertible_v<const Payload &, QVariant>, bool> = true>
+    void submitEvent(const QString &eventName, const Payload &payload)
+    {
+        submitEvent(eventName, QVariant::fromValue(payload));
+    }
+    void submitEventFromAnyThread(QScxmlEvent *event);
+    void submitEvents(QSpan<QScxmlEvent * const> events);
+    void processUntilStable();
     Q_INVOKABLE void cancelDelayedEvent(const QString &sendId);
 
     Q_INVOKABLE bool isDispatchableTarget(const QString &target) const;
@@ -18,9 +18,13 @@
 #include <QtScxml/private/qscxmlexecutablecontent_p.h>
 #include <QtScxml/qscxmlstatemachine.h>
 #include <QtScxml/private/qscxmlstatemachineinfo_p.h>
+#include <QtScxml/private/qscxmltableindex_p.h>
 #include <QtCore/private/qobject_p.h>
 #include <QtCore/private/qmetaobject_p.h>
 #include <QtCore/private/qproperty_p.h>
+#include <QtCore/qalgorithms.h>
+#include <QtCore/qatomic.h>
+#include <QtCore/qbasictimer.h>
 #include <QtCore/qhash.h>
 #include <QtCore/qmap.h>
 #include <QtCore/qvariant.h>
@@ -30,6 +34,117 @@
 QT_BEGIN_NAMESPACE
 
 namespace QScxmlInternal {
+// The pending delayed events of a state machine, kept in a binary min-heap ordered by due time
+// and submission order. A single timer on the EventLoopHook serves all of them.
+//
+// Events are also indexed by send ID. Cancelling one only drops it from the indexes, and leaves
+// its heap entry behind. Such stale entries are discarded when they reach the top of the heap,
+// or all at once when they make up most of it.
+class DelayedEventQueue
+{
+    Q_DISABLE_COPY(DelayedEventQueue)
+
+public:
+    DelayedEventQueue() = default;
+    ~DelayedEventQueue() { clear(); }
+
+    // Takes ownership of the event, which becomes due at the given deadline in milliseconds as
+    // returned by QDeadlineTimer::deadline(). Returns the sequence number of the event.
+    quint64 schedule(QScxmlEvent *event, qint64 deadline);
+
+    // Removes the earliest submitted event with the send ID, and returns it. The caller takes
+    // ownership. Returns nullptr if there is no such event.
+    QScxmlEvent *cancel(const QString &sendId);
+
+    bool isEmpty() const { return m_events.isEmpty(); }
+    int size() const { return int(m_events.size()); }
+
+    qint64 nextDeadline() const
+    {
+        Q_ASSERT(!isEmpty());
+        return m_heap.front().deadline;
+    }
+
+    // Removes the event that is due first, and returns it. The caller takes ownership.
+    QScxmlEvent *takeNext();
+
+    // Deletes all pending events.
+    void clear();
+
+private:
+    struct Entry {
+        qint64 deadline;
+        quint64 sequence;
+
+        // std::push_heap() and friends build a max-heap, so this sorts the earliest entry last.
+        bool operator<(const Entry &other) const
+        {
+            return deadline != other.deadline ? deadline > other.deadline
+                                              : sequence > other.sequence;
+        }
+    };
+
+    void dropStaleEntries();
+
+    std::vector<Entry> m_heap;
+    QHash<quint64, QScxmlEvent *> m_events; // the live entries, by sequence number
+    QMultiHash<QString, quint64> m_sendIds;
+    quint64 m_nextSequence = 0;
+};
+
+// Events submitted from other threads than the one of the state machine. Any thread can push,
+// only the state machine's thread takes the events. The queue is a lock-free linked stack: a
+// push is a single compare-and-swap, and the consumer takes the whole stack at once and
+// reverses it into submission order.
+class ConcurrentEventQueue
+{
+    Q_DISABLE_COPY(ConcurrentEventQueue)
+
+    struct Node {
+        QScxmlEvent *event;
+        Node *next;
+    };
+
+    QAtomicPointer<Node> m_head;
+
+public:
+    ConcurrentEventQueue() = default;
+    ~ConcurrentEventQueue() { takeAll([](QScxmlEvent *event) { delete event; }); }
+
+    // Thread-safe. Returns true if the queue was empty before, in which case the consumer has
+    // to be woken up. Otherwise a wake-up is pending already.
+    bool push(QScxmlEvent *event)
+    {
+        Node *node = new Node{ event, nullptr };
+        Node *head = m_head.loadRelaxed();
+        do {
+            node->next = head;
+        } while (!m_head.testAndSetRelease(head, node, head));
+        return head == nullptr;
+    }
+
+    // Passes all queued events to f, in the order they were pushed.
+    template <typename Func>
+    void takeAll(Func f)
+    {
+        Node *node = m_head.fetchAndStoreAcquire(nullptr);
+        Node *reversed = nullptr;
+        while (node) {
+            Node *next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+        while (reversed) {
+            Node *next = reversed->next;
+            QScxmlEvent *event = reversed->event;
+            delete reversed;
+            f(event);
+            reversed = next;
+        }
+    }
+};
+
 class EventLoopHook: public QObject
 {
     Q_OBJECT
@@ -42,11 +157,23 @@ public:
     {}
 
     void queueProcessEvents();
+    // Makes a pending queued call do nothing, as the events it was queued for are processed now.
+    void discardQueuedProcessEvents() { m_processEventsQueued = false; }
+
+    // (Re)starts the timer for the earliest delayed event, if it is due before the timer fires.
+    void updateDelayedEventTimer();
+    void stopDelayedEventTimer();
 
     Q_INVOKABLE void doProcessEvents();
+    Q_INVOKABLE void doSubmitConcurrentEvents();
 
 protected:
     void timerEvent(QTimerEvent *timerEvent) override;
+
+private:
+    bool m_processEventsQueued = false;
+    QBasicTimer m_delayedEventTimer;
+    qint64 m_delayedEventTimerDeadline = 0;
 };
 
 class ScxmlEventRouter : public QObject
@@ -98,22 +225,45 @@ class Q_SCXML_EXPORT QScxmlStateMachinePrivate: public QObjectPrivate
 public: // types
     typedef QScxmlExecutableContent::StateTable StateTable;
 
+    // Maps states to the content of their default history transition. The values are kept in a
+    // vector indexed by state, and clear() only resets the entries that were set.
     class HistoryContent
     {
-        QHash<int, int> storage;
+        std::vector<int> storage;
+        std::vector<int> setIndexes;
 
     public:
-        HistoryContent() { storage.reserve(4); }
+        void reserve(int stateCount)
+        {
+            if (storage.size() < size_t(stateCount))
+                storage.resize(size_t(stateCount), StateTable::InvalidIndex);
+            setIndexes.reserve(size_t(stateCount));
+        }
+
+        void set(int idx, int container)
+        {
+            Q_ASSERT(idx >= 0);
+            if (size_t(idx) >= storage.size())
+                storage.resize(size_t(idx) + 1, StateTable::InvalidIndex);
+            if (storage[size_t(idx)] == StateTable::InvalidIndex) {
+                if (container == StateTable::InvalidIndex)
+                    return;
+                setIndexes.push_back(idx);
+            }
+            storage[size_t(idx)] = container;
+        }
 
-        int &operator[](int idx) {
-            QHash<int, int>::Iterator i = storage.find(idx);
-            return (i == storage.end()) ? storage.insert(idx, StateTable::InvalidIndex).value() :
-                                          i.value();
+        int value(int idx) const
+        {
+            return (idx >= 0 && size_t(idx) < storage.size()) ? storage[size_t(idx)]
+                                                              : StateTable::InvalidIndex;
         }
 
-        int value(int idx) const {
-            QHash<int, int>::ConstIterator i = storage.constFind(idx);
-            return (i == storage.constEnd()) ? StateTable::InvalidIndex : i.value();
+        void clear()
+        {
+            for (int idx : setIndexes)
+                storage[size_t(idx)] = StateTable::InvalidIndex;
+            setIndexes.clear();
         }
     };
 
@@ -127,88 +277,178 @@ public: // types
     // The OrderedSet is a set where it elements are in insertion order. See
     // http://www.w3.org/TR/scxml/#AlgorithmforSCXMLInterpretation under Algorithm, Datatypes. It
     // is used to keep lists of states and transitions in document order.
+    //
+    // Next to the insertion-ordered list, membership is tracked in a dense bitset indexed by the
+    // state or transition index. This makes contains() and add() O(1). As indexes are assigned in
+    // document order, the bitset also gives the elements in document order without sorting. Call
+    // reserve() with the state or transition count of the table to avoid growing the bitset later
+    // on. clear() keeps the allocated storage, so a set can be reused without allocating.
     class OrderedSet
     {
         std::vector<int> storage;
+        std::vector<quint64> bits;
+
+        static size_t wordIndex(int i) { return size_t(i) / 64; }
+        static quint64 bitMask(int i) { return quint64(1) << (uint(i) % 64); }
+
+        bool testBit(int i) const
+        {
+            const size_t w = wordIndex(i);
+            return w < bits.size() && (bits[w] & bitMask(i));
+        }
+
+        void clearBits()
+        {
+            for (int i : storage)
+                bits[wordIndex(i)] &= ~bitMask(i);
+        }
 
     public:
         OrderedSet(){}
-        OrderedSet(std::initializer_list<int> l): storage(l) {}
+        OrderedSet(std::initializer_list<int> l)
+        {
+            for (int i : l)
+                add(i);
+        }
 
-        std::vector<int> takeList() const
-        { return std::move(storage); }
+        void reserve(int count)
+        {
+            const size_t wordCount = (size_t(count) + 63) / 64;
+            if (bits.size() < wordCount)
+                bits.resize(wordCount, 0);
+            storage.reserve(size_t(count));
+        }
+
+        // Moves the elements into result, in insertion order, and clears the set. The storage of
+        // result is reused.
+        void takeList(std::vector<int> *result)
+        {
+            Q_ASSERT(result);
+            result->assign(storage.cbegin(), storage.cend());
+            clear();
+        }
+
+        // Like takeList(), but the result is in document order instead of insertion order.
+        void takeSortedList(std::vector<int> *result)
+        {
+            Q_ASSERT(result);
+            result->resize(storage.size());
+            auto out = result->begin();
+            for (size_t w = 0, ew = bits.size(); w != ew && out != result->end(); ++w) {
+                for (quint64 word = bits[w]; word; word &= word - 1)
+                    *out++ = int(w * 64 + qCountTrailingZeroBits(word));
+                bits[w] = 0;
+            }
+            storage.clear();
+        }
 
         const std::vector<int> &list() const
         { return storage; }
 
+        template <typename Func>
+        void forEachInDocumentOrder(Func f) const
+        {
+            for (size_t w = 0, ew = bits.size(); w != ew; ++w) {
+                for (quint64 word = bits[w]; word; word &= word - 1)
+                    f(int(w * 64 + qCountTrailingZeroBits(word)));
+            }
+        }
+
         bool contains(int i) const
         {
-            return std::find(storage.cbegin(), storage.cend(), i) != storage.cend();
+            return i >= 0 && testBit(i);
         }
 
         bool remove(int i)
         {
-            std::vector<int>::iterator it = std::find(storage.begin(), storage.end(), i);
-            if (it == storage.end()) {
+            if (!contains(i))
                 return false;
-            }
-            storage.erase(it);
+            bits[wordIndex(i)] &= ~bitMask(i);
+            storage.erase(std::find(storage.begin(), storage.end(), i));
             return true;
         }
 
         void removeHead()
-        { if (!isEmpty()) storage.erase(storage.begin()); }
+        {
+            if (!isEmpty()) {
+                bits[wordIndex(storage.front())] &= ~bitMask(storage.front());
+                storage.erase(storage.begin());
+            }
+        }
 
         bool isEmpty() const
         { return storage.empty(); }
 
         void add(int i)
-        { if (!contains(i)) storage.push_back(i); }
-
-        bool intersectsWith(const OrderedSet &other) const
         {
-            for (auto i : storage) {
-                if (other.contains(i)) {
-                    return true;
-                }
-            }
-            return false;
+            Q_ASSERT(i >= 0);
+            const size_t w = wordIndex(i);
+            if (w >= bits.size())
+                bits.resize(w + 1, 0);
+            if (bits[w] & bitMask(i))
+                return;
+            bits[w] |= bitMask(i);
+            storage.push_back(i);
         }
 
         void clear()
-        { storage.clear(); }
+        {
+            clearBits();
+            storage.clear();
+        }
 
         typedef std::vector<int>::const_iterator const_iterator;
         const_iterator begin() const { return storage.cbegin(); }
         const_iterator end() const { return storage.cend(); }
     };
 
+    // A FIFO of events in a ring buffer. The capacity is a power of two, and only grows, so that
+    // after a burst the queue keeps working without allocating.
     class Queue
     {
-        QList<QScxmlEvent *> storage;
+        std::vector<QScxmlEvent *> storage;
+        size_t head = 0;
+        size_t count = 0;
+
+        size_t mask() const { return storage.size() - 1; }
+
+        void grow()
+        {
+            std::vector<QScxmlEvent *> bigger(storage.size() * 2, nullptr);
+            for (size_t i = 0; i != count; ++i)
+                bigger[i] = storage[(head + i) & mask()];
+            storage.swap(bigger);
+            head = 0;
+        }
 
     public:
         Queue()
-        { storage.reserve(4); }
+            : storage(4, nullptr)
+        {}
 
         ~Queue()
-        {  qDeleteAll(storage); }
+        {
+            while (!isEmpty())
+                delete dequeue();
+        }
 
         void enqueue(QScxmlEvent *e)
-        { storage.append(e); }
+        {
+            if (count == storage.size())
+                grow();
+            storage[(head + count) & mask()] = e;
+            ++count;
+        }
 
         bool isEmpty() const
-        { return storage.empty(); }
+        { return count == 0; }
 
         QScxmlEvent *dequeue()
         {
             Q_ASSERT(!isEmpty());
-            QScxmlEvent *e = storage.first();
-            storage.pop_front();
-            int sz = storage.size();
-            if (Q_UNLIKELY(sz > 4 && sz * 8 < storage.capacity())) {
-                storage.squeeze();
-            }
+            QScxmlEvent *e = storage[head];
+            head = (head + 1) & mask();
+            --count;
             return e;
         }
     };
@@ -235,7 +475,10 @@ public:
 
     void routeEvent(QScxmlEvent *event);
     void postEvent(QScxmlEvent *event);
+    void enqueueEvent(QScxmlEvent *event);
     void submitDelayedEvent(QScxmlEvent *event);
+    // Queues the events submitted from other threads. The caller processes them.
+    void submitConcurrentEvents();
     void submitError(const QString &type, const QString &msg, const QString &sendid = QString());
 
     void start();
@@ -255,16 +498,12 @@ public:
 
 private:
     QStringList stateNames(const std::vector<int> &stateIndexes) const;
-    std::vector<int> historyStates(int stateIdx) const;
 
     void exitInterpreter();
     void returnDoneEvent(QScxmlExecutableContent::ContainerId doneData);
-    bool nameMatch(const StateTable::Array &patterns, QScxmlEvent *event) const;
-    void selectTransitions(OrderedSet &enabledTransitions,
-                           const std::vector<int> &configInDocumentOrder,
-                           QScxmlEvent *event) const;
+    void selectTransitions(OrderedSet &enabledTransitions, QScxmlEvent *event) const;
     void removeConflictingTransitions(OrderedSet *enabledTransitions) const;
-    void getProperAncestors(std::vector<int> *ancestors, int state1, int state2) const;
+    bool exitSetsIntersect(int domain1, int domain2) const;
     void microstep(const OrderedSet &enabledTransitions);
     void exitStates(const OrderedSet &enabledTransitions);
     void computeExitSet(const OrderedSet &enabledTransitions, OrderedSet &statesToExit) const;
@@ -284,6 +523,24 @@ private:
                                   OrderedSet *statesForDefaultEntry,
                                   HistoryContent *defaultHistoryContent) const;
     std::vector<int> getChildStates(const StateTable::State &state) const;
+    template <typename Func>
+    void forEachChildState(const StateTable::State &state, Func f) const
+    {
+        const auto kids = m_stateTable->array(state.childStates);
+        if (!kids.isValid())
+            return;
+        for (int kiddo : kids) {
+            switch (m_stateTable->state(kiddo).type) {
+            case StateTable::State::Normal:
+            case StateTable::State::Final:
+            case StateTable::State::Parallel:
+                f(kiddo);
+                break;
+            default:
+                break;
+            }
+        }
+    }
     bool hasDescendant(const OrderedSet &statesToEnter, int childIdx) const;
     bool allDescendants(const OrderedSet &statesToEnter, int childdx) const;
     bool isDescendant(int state1, int state2) const;
@@ -291,7 +548,7 @@ private:
     bool someInFinalStates(const std::vector<int> &states) const;
     bool isInFinalState(int stateIndex) const;
     int getTransitionDomain(int transitionIndex) const;
-    int findLCCA(OrderedSet &&states) const;
+    int findLCCA(int source, const OrderedSet &targets) const;
     void getEffectiveTargetStates(OrderedSet *targets, int transitionIndex) const;
 
 public: // types & data fields:
@@ -338,10 +595,11 @@ public: // types & data fields:
     QScxmlCompilerPrivate::DefaultLoader m_defaultLoader;
     QScxmlExecutionEngine *m_executionEngine;
     const StateTable *m_stateTable;
+    QSharedPointer<const QScxmlInternal::TableIndex> m_tableIndex;
     QScxmlStateMachine *m_parentStateMachine;
     QScxmlInternal::EventLoopHook m_eventLoopHook;
-    typedef std::vector<std::pair<int, QScxmlEvent *>> DelayedQueue;
-    DelayedQueue m_delayedEvents;
+    QScxmlInternal::DelayedEventQueue m_delayedEvents;
+    QScxmlInternal::ConcurrentEventQueue m_concurrentEvents;
     const QMetaObject *m_metaObject;
     QScxmlInternal::ScxmlEventRouter m_router;
 
@@ -357,6 +615,47 @@ private:
     // TODO: move the stuff below to a struct that can be reset
     HistoryValues m_historyValue;
     OrderedSet m_configuration;
+
+    // Buffers reused by every macrostep, so that processing an event does not allocate once they
+    // have grown to their working size. setTableData() sizes them for the state table. They are
+    // mutable as the const helpers of the algorithm use them as well. processEvents() is not
+    // reentrant, and neither are the helpers using a buffer.
+    struct Scratch
+    {
+        OrderedSet enabledTransitions;
+        OrderedSet filteredTransitions;
+        OrderedSet transitionsToRemove;
+        OrderedSet statesToExit;
+        OrderedSet statesToEnter;
+        OrderedSet statesForDefaultEntry;
+        OrderedSet domainTargets; // used by getTransitionDomain()
+        OrderedSet entryTargets; // used by computeEntrySet()
+        HistoryContent defaultHistoryContent;
+        std::vector<int> sortedTransitions;
+        std::vector<int> sortedStatesToExit;
+        std::vector<int> sortedStatesToEnter;
+        std::vector<int> eventPrefixIds;
+        std::vector<int> candidates;
+
+        void reserve(int stateCount, int transitionCount)
+        {
+            enabledTransitions.reserve(transitionCount);
+            filteredTransitions.reserve(transitionCount);
+            transitionsToRemove.reserve(transitionCount);
+            statesToExit.reserve(stateCount);
+            statesToEnter.reserve(stateCount);
+            statesForDefaultEntry.reserve(stateCount);
+            domainTargets.reserve(stateCount);
+            entryTargets.reserve(stateCount);
+            defaultHistoryContent.reserve(stateCount);
+            sortedTransitions.reserve(size_t(transitionCount));
+            sortedStatesToExit.reserve(size_t(stateCount));
+            sortedStatesToEnter.reserve(size_t(stateCount));
+            candidates.reserve(size_t(transitionCount));
+            eventPrefixIds.reserve(16);
+        }
+    };
+    mutable Scratch m_scratch;
     Queue m_internalQueue;
     Queue m_externalQueue;
     QSet<int> m_statesToInvoke;
@@ -395,8 +694,7 @@ private:
 
     QScxmlInternal::StateMachineInfoProxy *m_infoSignalProxy;
 
-    QHash<int, int> m_stateIndexToSignalIndex;
-    QHash<QString, int> m_stateNameToSignalIndex;
+    int m_stateSignalOffset = 0;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,334 @@
+// Copyright (C) 2026 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only OR GPL-3.0-only
+
+#include "qscxmltableindex_p.h"
+
+#include <QtCore/qhash.h>
+#include <QtCore/qmutex.h>
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QScxmlInternal;
+
+namespace {
+// State machines compiled with qscxmlc keep their tables in static data, so the address of the
+// state table identifies it for the lifetime of the process. Dynamically created state machines
+// release their index before their table goes away, so an expired entry can never be confused
+// with a new table at the same address.
+struct TableIndexRegistry
+{
+    QMutex mutex;
+    QHash<const qint32 *, QWeakPointer<const TableIndex>> indexes;
+};
+}
+
+Q_GLOBAL_STATIC(TableIndexRegistry, tableIndexRegistry)
+
+QSharedPointer<const TableIndex> TableIndex::get(const QScxmlTableData *tableData)
+{
+    Q_ASSERT(tableData);
+    const qint32 *key = tableData->stateMachineTable();
+
+    TableIndexRegistry *registry = tableIndexRegistry();
+    QMutexLocker locker(&registry->mutex);
+    if (QSharedPointer<const TableIndex> index = registry->indexes.value(key).toStrongRef())
+        return index;
+
+    for (auto it = registry->indexes.begin(); it != registry->indexes.end();) {
+        if (it.value().isNull())
+            it = registry->indexes.erase(it);
+        else
+            ++it;
+    }
+
+    QSharedPointer<const TableIndex> index(new TableIndex(tableData));
+    registry->indexes.insert(key, index);
+    return index;
+}
+
+TableIndex::TableIndex(const QScxmlTableData *tableData)
+    : m_stateTable(reinterpret_cast<const StateTable *>(tableData->stateMachineTable()))
+{
+    buildNames(tableData);
+    buildTopology();
+    buildTransitionDomains();
+    buildTransitionIndex(tableData);
+    buildCode(tableData);
+}
+
+void TableIndex::buildNames(const QScxmlTableData *tableData)
+{
+    const int stateCount = std::max(m_stateTable->stateCount, 0);
+    m_stateIndexes.reserve(stateCount);
+    m_signalIndexes.resize(size_t(stateCount), -1);
+    for (int s = 0; s < stateCount; ++s) {
+        const auto &state = m_stateTable->state(s);
+        if (state.isHistoryState() || state.type == StateTable::State::Invalid)
+            continue;
+        // Names are unique in a valid document. Otherwise, the last state wins, as does its
+        // signal in the generated meta object.
+        m_stateIndexes.insert(tableData->string(state.name), s);
+        m_signalIndexes[size_t(s)] = int(m_signalStateIndexes.size());
+        m_signalStateIndexes.push_back(s);
+    }
+}
+
+void TableIndex::buildTopology()
+{
+    const int stateCount = std::max(m_stateTable->stateCount, 0);
+
+    m_levels.resize(size_t(stateCount), 0);
+    m_ancestorOffsets.reserve(size_t(stateCount) + 1);
+    for (int s = 0; s < stateCount; ++s) {
+        m_ancestorOffsets.push_back(int(m_ancestors.size()));
+        int level = 1;
+        for (int p = m_stateTable->state(s).parent; p != StateTable::InvalidIndex;
+             p = m_stateTable->state(p).parent) {
+            m_ancestors.push_back(p);
+            ++level;
+        }
+        m_levels[size_t(s)] = level;
+    }
+    m_ancestorOffsets.push_back(int(m_ancestors.size()));
+
+    // Number the states in a depth-first walk, so that the descendants of a state are the ones
+    // numbered after it, up to and including its last descendant.
+    m_preorder.resize(size_t(stateCount), -1);
+    m_lastDescendant.resize(size_t(stateCount), -1);
+    int position = 0;
+    std::vector<std::pair<int, int>> stack; // state, index of the next child to visit
+    stack.reserve(16);
+    const auto visit = [&](int s) {
+        m_preorder[size_t(s)] = position++;
+        stack.emplace_back(s, 0);
+    };
+    for (int topLevelState : m_stateTable->array(m_stateTable->childStates)) {
+        visit(topLevelState);
+        while (!stack.empty()) {
+            const int s = stack.back().first;
+            const StateTable::Array kids = m_stateTable->array(m_stateTable->state(s).childStates);
+            if (kids.isValid() && stack.back().second < kids.size()) {
+                visit(kids[stack.back().second++]);
+            } else {
+                m_lastDescendant[size_t(s)] = position - 1;
+                stack.pop_back();
+            }
+        }
+    }
+    Q_ASSERT(position == stateCount);
+}
+
+void TableIndex::buildTransitionDomains()
+{
+    const int transitionCount = std::max(m_stateTable->transitionCount, 0);
+    m_transitionDomains.reserve(size_t(transitionCount));
+    for (int t = 0; t < transitionCount; ++t)
+        m_transitionDomains.push_back(staticTransitionDomain(t));
+}
+
+// Same as QScxmlStateMachinePrivate::getTransitionDomain(), for transitions where the effective
+// targets are the targets themselves.
+int TableIndex::staticTransitionDomain(int transitionIndex) const
+{
+    const auto &transition = m_stateTable->transition(transitionIndex);
+    if (transition.source == StateTable::InvalidIndex)
+        return StateTable::InvalidIndex;
+
+    const StateTable::Array targets = m_stateTable->array(transition.targets);
+    if (!targets.isValid() || targets.size() == 0)
+        return StateTable::InvalidIndex;
+    for (int s : targets) {
+        if (m_stateTable->state(s).isHistoryState())
+            return DynamicDomain;
+    }
+
+    const auto allDescendants = [&](int ancestor) {
+        for (int s : targets) {
+            if (!isDescendant(s, ancestor))
+                return false;
+        }
+        return true;
+    };
+
+    if (transition.type == StateTable::Transition::Internal
+            && m_stateTable->state(transition.source).isCompound()
+            && allDescendants(transition.source)) {
+        return transition.source;
+    }
+
+    // Find the least common compound ancestor of the source and the targets.
+    for (int anc : properAncestors(targets[0])) {
+        if (!m_stateTable->state(anc).isCompound())
+            continue;
+        if (isDescendant(transition.source, anc) && allDescendants(anc))
+            return anc;
+    }
+    return StateTable::InvalidIndex;
+}
+
+void TableIndex::buildTransitionIndex(const QScxmlTableData *tableData)
+{
+    const int stateCount = std::max(m_stateTable->stateCount, 0);
+    const int transitionCount = std::max(m_stateTable->transitionCount, 0);
+
+    // Intern the descriptors of all transitions.
+    std::vector<int> descriptorOffsets;
+    std::vector<int> descriptorPrefixes;
+    descriptorOffsets.reserve(size_t(transitionCount) + 1);
+    QHash<QString, int> ids;
+    m_prefixes.append(QStringLiteral("*"));
+    for (int t = 0; t < transitionCount; ++t) {
+        descriptorOffsets.push_back(int(descriptorPrefixes.size()));
+        const StateTable::Array events = m_stateTable->array(m_stateTable->transition(t).events);
+        if (!events.isValid())
+            continue;
+        for (int stringId : events) {
+            QString descriptor = tableData->string(stringId);
+            int id = AnyEventPrefix;
+            if (descriptor != QStringLiteral("*")) {
+                if (descriptor.endsWith(QStringLiteral(".*")))
+                    descriptor.chop(2);
+                id = ids.value(descriptor, -1);
+                if (id == -1) {
+                    id = int(m_prefixes.size());
+                    m_prefixes.append(descriptor);
+                    ids.insert(descriptor, id);
+                    m_prefixesByHash.push_back({ qHash(QStringView(descriptor)), id });
+                }
+            }
+            const auto first = descriptorPrefixes.cbegin() + descriptorOffsets.back();
+            if (std::find(first, descriptorPrefixes.cend(), id) == descriptorPrefixes.cend())
+                descriptorPrefixes.push_back(id);
+        }
+    }
+    descriptorOffsets.push_back(int(descriptorPrefixes.size()));
+    std::sort(m_prefixesByHash.begin(), m_prefixesByHash.end());
+
+    // Sort the transitions of each state into an eventless list, and into one bucket for each
+    // prefix ID that occurs in their descriptors.
+    m_transitionPosition.resize(size_t(transitionCount), 0);
+    m_eventlessOffsets.reserve(size_t(stateCount) + 1);
+    m_bucketOffsets.reserve(size_t(stateCount) + 1);
+    std::vector<std::pair<int, int>> keyed; // prefix ID, transition
+    for (int s = 0; s < stateCount; ++s) {
+        m_eventlessOffsets.push_back(int(m_eventlessTransitions.size()));
+        m_bucketOffsets.push_back(int(m_buckets.size()));
+        const auto &state = m_stateTable->state(s);
+        const StateTable::Array transitions = m_stateTable->array(state.transitions);
+        if (!transitions.isValid())
+            continue;
+
+        keyed.clear();
+        int position = 0;
+        for (int t : transitions) {
+            m_transitionPosition[size_t(t)] = position++;
+            if (m_stateTable->transition(t).events == StateTable::InvalidIndex) {
+                m_eventlessTransitions.push_back(t);
+                continue;
+            }
+            for (int i = descriptorOffsets[t], ei = descriptorOffsets[t + 1]; i != ei; ++i)
+                keyed.emplace_back(descriptorPrefixes[i], t);
+        }
+
+        std::stable_sort(keyed.begin(), keyed.end(),
+                         [](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+            return a.first < b.first;
+        });
+        for (const auto &entry : keyed) {
+            if (m_buckets.size() == size_t(m_bucketOffsets.back())
+                    || m_buckets.back().prefixId != entry.first) {
+                const int first = int(m_bucketTransitions.size());
+                m_buckets.push_back({ entry.first, first, first });
+            }
+            m_bucketTransitions.push_back(entry.second);
+            ++m_buckets.back().last;
+        }
+    }
+    m_eventlessOffsets.push_back(int(m_eventlessTransitions.size()));
+    m_bucketOffsets.push_back(int(m_buckets.size()));
+}
+
+void TableIndex::buildCode(const QScxmlTableData *tableData)
+{
+    m_code.add(tableData, tableData->initialSetup());
+    for (int s = 0, stateCount = std::max(m_stateTable->stateCount, 0); s < stateCount; ++s) {
+        const auto &state = m_stateTable->state(s);
+        m_code.add(tableData, state.initInstructions);
+        m_code.add(tableData, state.entryInstructions);
+        m_code.add(tableData, state.exitInstructions);
+        m_code.add(tableData, state.doneData);
+    }
+    for (int t = 0, transitionCount = std::max(m_stateTable->transitionCount, 0);
+            t < transitionCount; ++t) {
+        m_code.add(tableData, m_stateTable->transition(t).transitionInstructions);
+    }
+}
+
+int TableIndex::prefixId(QStringView prefix) const
+{
+    const PrefixHash key = { qHash(prefix), -1 };
+    const auto range = std::equal_range(m_prefixesByHash.cbegin(), m_prefixesByHash.cend(), key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (m_prefixes.at(it->id) == prefix)
+            return it->id;
+    }
+    return -1;
+}
+
+// A descriptor matches an event name if it is a prefix of the name that is followed by a '.' or
+// a '(', or by nothing at all. Collect the IDs of all such prefixes that occur as descriptors.
+void TableIndex::eventPrefixes(QStringView eventName, std::vector<int> *prefixIds) const
+{
+    Q_ASSERT(prefixIds);
+
+    prefixIds->clear();
+    prefixIds->push_back(AnyEventPrefix);
+    if (m_prefixesByHash.empty())
+        return;
+
+    for (qsizetype i = 0, ei = eventName.size(); i <= ei; ++i) {
+        if (i == ei || eventName.at(i) == QLatin1Char('.') || eventName.at(i) == QLatin1Char('(')) {
+            const int id = prefixId(eventName.left(i));
+            if (id != -1)
+                prefixIds->push_back(id);
+        }
+    }
+}
+
+void TableIndex::eventTransitions(int stateIndex, const std::vector<int> &eventPrefixIds,
+                                  std::vector<int> *transitions) const
+{
+    Q_ASSERT(stateIndex >= 0 && stateIndex < m_stateTable->stateCount);
+    Q_ASSERT(transitions);
+
+    transitions->clear();
+    const Bucket *first = m_buckets.data() + m_bucketOffsets[stateIndex];
+    const Bucket *last = m_buckets.data() + m_bucketOffsets[stateIndex + 1];
+    if (first == last)
+        return;
+
+    int bucketCount = 0;
+    for (int id : eventPrefixIds) {
+        const Bucket *it = std::lower_bound(first, last, id, [](const Bucket &bucket, int value) {
+            return bucket.prefixId < value;
+        });
+        if (it != last && it->prefixId == id) {
+            transitions->insert(transitions->end(), m_bucketTransitions.data() + it->first,
+                                m_bucketTransitions.data() + it->last);
+            ++bucketCount;
+        }
+    }
+
+    // Each bucket is in document order, but a transition can be in several of them.
+    if (bucketCount > 1) {
+        std::sort(transitions->begin(), transitions->end(), [this](int t1, int t2) {
+            return m_transitionPosition[size_t(t1)] < m_transitionPosition[size_t(t2)];
+        });
+        transitions->erase(std::unique(transitions->begin(), transitions->end()),
+                           transitions->end());
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,187 @@
+// Copyright (C) 2026 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only OR GPL-3.0-only
+
+#ifndef QSCXMLTABLEINDEX_P_H
+#define QSCXMLTABLEINDEX_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtScxml/private/qscxmlexecutablecontent_p.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qsharedpointer.h>
+#include <QtCore/qstringlist.h>
+
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+
+namespace QScxmlInternal {
+
+// The TableIndex holds data that is derived from a state table, and that the interpreter would
+// otherwise have to recalculate on every event. It is immutable once built, and shared between
+// all state machines that use the same table.
+class TableIndex
+{
+    Q_DISABLE_COPY(TableIndex)
+
+public:
+    typedef QScxmlExecutableContent::StateTable StateTable;
+
+    // Returns the index for the given table data, building it if no state machine using the
+    // same table has done so yet.
+    static QSharedPointer<const TableIndex> get(const QScxmlTableData *tableData);
+
+    // Event descriptors are compiled into prefix IDs. An event name is split once into all of
+    // its prefixes that a descriptor can match, and a transition matches the event if one of its
+    // descriptors has one of those prefix IDs. The "*" descriptor maps to AnyEventPrefix, which
+    // is part of the prefixes of every event.
+    enum { AnyEventPrefix = 0 };
+    void eventPrefixes(QStringView eventName, std::vector<int> *prefixIds) const;
+
+    struct IndexRange {
+        const int *first;
+        const int *last;
+
+        const int *begin() const { return first; }
+        const int *end() const { return last; }
+        bool isEmpty() const { return first == last; }
+    };
+
+    // The proper ancestors of a state, starting with its parent. The <scxml> element itself is
+    // not included.
+    IndexRange properAncestors(int stateIndex) const
+    {
+        Q_ASSERT(stateIndex >= 0 && stateIndex < m_stateTable->stateCount);
+        const int *data = m_ancestors.data();
+        return { data + m_ancestorOffsets[stateIndex], data + m_ancestorOffsets[stateIndex + 1] };
+    }
+
+    // The number of states on the path from the state up to the <scxml> element, including the
+    // state itself. The <scxml> element, InvalidIndex, has level 0.
+    int level(int stateIndex) const
+    {
+        return stateIndex == StateTable::InvalidIndex ? 0 : m_levels[size_t(stateIndex)];
+    }
+
+    // Returns whether state1 is a proper descendant of state2. Every state is a descendant of
+    // the <scxml> element, InvalidIndex.
+    bool isDescendant(int state1, int state2) const
+    {
+        Q_ASSERT(state1 >= 0 && state1 < m_stateTable->stateCount);
+        if (state2 == StateTable::InvalidIndex)
+            return true;
+        const int entry = m_preorder[size_t(state1)];
+        return m_preorder[size_t(state2)] < entry && entry <= m_lastDescendant[size_t(state2)];
+    }
+
+    // The domain of a transition whose targets contain no history states does not depend on
+    // the run time state of the machine. For those it is calculated once. DynamicDomain is
+    // returned for the others.
+    enum { DynamicDomain = -2 };
+    int transitionDomain(int transitionIndex) const
+    {
+        Q_ASSERT(transitionIndex >= 0 && transitionIndex < m_stateTable->transitionCount);
+        return m_transitionDomains[size_t(transitionIndex)];
+    }
+
+    // Returns the index of the state with the given name, or InvalidIndex if there is none.
+    int stateIndex(const QString &name) const
+    {
+        return m_stateIndexes.value(name, StateTable::InvalidIndex);
+    }
+
+    // A state machine has a signal for every state that is neither a history state nor invalid.
+    // These map between the index of a state and the index of its signal, relative to the first
+    // state signal. Returns -1 if there is no such signal or state.
+    int signalIndex(int stateIndex) const
+    {
+        return (stateIndex >= 0 && size_t(stateIndex) < m_signalIndexes.size())
+                ? m_signalIndexes[size_t(stateIndex)] : -1;
+    }
+    int signalStateIndex(int signalIndex) const
+    {
+        return (signalIndex >= 0 && size_t(signalIndex) < m_signalStateIndexes.size())
+                ? m_signalStateIndexes[size_t(signalIndex)] : -1;
+    }
+
+    // The transitions of a state without events, in document order.
+    IndexRange eventlessTransitions(int stateIndex) const
+    {
+        Q_ASSERT(stateIndex >= 0 && stateIndex < m_stateTable->stateCount);
+        const int *data = m_eventlessTransitions.data();
+        return { data + m_eventlessOffsets[stateIndex], data + m_eventlessOffsets[stateIndex + 1] };
+    }
+
+    // Collects the transitions of a state whose event descriptors match an event with the given
+    // prefixes, in document order.
+    void eventTransitions(int stateIndex, const std::vector<int> &eventPrefixIds,
+                          std::vector<int> *transitions) const;
+
+    // The decoded executable content of the initial setup, and of all states and transitions.
+    const ExecutableCode &code() const { return m_code; }
+
+private:
+    explicit TableIndex(const QScxmlTableData *tableData);
+
+    void buildNames(const QScxmlTableData *tableData);
+    void buildTopology();
+    void buildTransitionDomains();
+    void buildTransitionIndex(const QScxmlTableData *tableData);
+    void buildCode(const QScxmlTableData *tableData);
+    int staticTransitionDomain(int transitionIndex) const;
+    int prefixId(QStringView prefix) const;
+
+    struct PrefixHash {
+        size_t hash;
+        int id;
+
+        bool operator<(const PrefixHash &other) const { return hash < other.hash; }
+    };
+
+    // The transitions of one state that have a descriptor with the given prefix ID.
+    struct Bucket {
+        int prefixId;
+        int first; // range in m_bucketTransitions
+        int last;
+    };
+
+    const StateTable *m_stateTable;
+
+    std::vector<int> m_levels;
+    std::vector<int> m_preorder; // position of a state in a depth-first walk of the tree
+    std::vector<int> m_lastDescendant; // position of the last descendant in the same walk
+    std::vector<int> m_ancestorOffsets; // stateCount + 1 offsets into m_ancestors
+    std::vector<int> m_ancestors;
+    std::vector<int> m_transitionDomains;
+
+    QHash<QString, int> m_stateIndexes;
+    std::vector<int> m_signalIndexes;
+    std::vector<int> m_signalStateIndexes;
+
+    QStringList m_prefixes; // indexed by prefix ID
+    std::vector<PrefixHash> m_prefixesByHash; // sorted by hash
+
+    std::vector<int> m_transitionPosition; // position in the transitions array of its source
+    std::vector<int> m_eventlessOffsets; // stateCount + 1 offsets into m_eventlessTransitions
+    std::vector<int> m_eventlessTransitions;
+    std::vector<int> m_bucketOffsets; // stateCount + 1 offsets into m_buckets
+    std::vector<Bucket> m_buckets; // sorted by prefix ID for each state
+    std::vector<int> m_bucketTransitions;
+
+    ExecutableCode m_code;
+};
+
+} // QScxmlInternal namespace
+
+QT_END_NAMESPACE
+
+#endif // QSCXMLTABLEINDEX_P_H
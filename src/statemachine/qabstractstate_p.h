@@ -63,6 +63,10 @@ public:
                                &QAbstractStatePrivate::activeChanged);
 
     mutable QState *parentState;
+
+    // Numbered by the machine, see QStateMachinePrivate::refreshDocumentOrder().
+    int documentOrder = -1;
+    int documentDepth = 0;
 };
 
 QT_END_NAMESPACE
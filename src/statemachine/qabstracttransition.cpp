@@ -7,6 +7,7 @@
 #include "qhistorystate.h"
 #include "qstate.h"
 #include "qstatemachine.h"
+#include "qstatemachine_p.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -106,6 +107,12 @@ QStateMachine *QAbstractTransitionPrivate::machine() const
     return nullptr;
 }
 
+// The machine keeps the effective targets and the domain of the transition across microsteps.
+void QAbstractTransitionPrivate::targetsOrTypeChanged()
+{
+    QStateMachinePrivate::invalidateTransitionCache(machine());
+}
+
 bool QAbstractTransitionPrivate::callEventTest(QEvent *e)
 {
     Q_Q(QAbstractTransition);
@@ -185,8 +192,10 @@ void QAbstractTransition::setTargetState(QAbstractState* target)
          (d->targetStates.isEmpty() && target == nullptr)) {
         return;
     }
-    if (!target)
+    if (!target) {
         d->targetStates.clear();
+        d->targetsOrTypeChanged();
+    }
     else
         setTargetStates(QList<QAbstractState*>() << target);
     emit targetStateChanged(QPrivateSignal());
@@ -261,6 +270,7 @@ void QAbstractTransition::setTargetStates(const QList<QAbstractState*> &targets)
     for (int i = 0; i < targets.size(); ++i) {
         d->targetStates[i] = targets.at(i);
     }
+    d->targetsOrTypeChanged();
 
     emit targetStatesChanged(QPrivateSignal());
 }
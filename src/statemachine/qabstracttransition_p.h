@@ -47,10 +47,13 @@ public:
     void emitTriggered();
 
     QList<QPointer<QAbstractState>> targetStates;
+    int documentOrder = -1; // see QStateMachinePrivate::refreshDocumentOrder()
 
+    void targetsOrTypeChanged();
     Q_OBJECT_BINDABLE_PROPERTY_WITH_ARGS(QAbstractTransitionPrivate,
                                          QAbstractTransition::TransitionType, transitionType,
-                                         QAbstractTransition::ExternalTransition);
+                                         QAbstractTransition::ExternalTransition,
+                                         &QAbstractTransitionPrivate::targetsOrTypeChanged);
 
 #if QT_CONFIG(animation)
     QList<QAbstractAnimation*> animations;
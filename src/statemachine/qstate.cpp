@@ -7,6 +7,7 @@
 #include "qabstracttransition.h"
 #include "qabstracttransition_p.h"
 #include "qsignaltransition.h"
+#include "qsignaltransition_p.h"
 #include "qstatemachine.h"
 #include "qstatemachine_p.h"
 
@@ -130,6 +131,15 @@ void QStatePrivate::emitPropertiesAssigned()
     emit q->propertiesAssigned(QState::QPrivateSignal());
 }
 
+void QStatePrivate::childModeChanged()
+{
+    Q_Q(QState);
+    // Whether a state is compound decides the domains of the transitions around it.
+    QStateMachinePrivate::invalidateTransitionCache(
+            isMachine ? static_cast<QStateMachine *>(q) : machine());
+    emit q->childModeChanged(QState::QPrivateSignal());
+}
+
 /*!
   Constructs a new state with the given \a parent state.
 */
@@ -207,6 +217,51 @@ QList<QAbstractTransition*> QStatePrivate::transitions() const
     return transitionsList;
 }
 
+/*
+    Returns the private data of t if it is a registered QSignalTransition that only accepts the
+    signal it is registered for, and nullptr otherwise. A subclass can reimplement eventTest() to
+    accept other signals, and an unregistered transition is tested like any other transition, so
+    both are tested against every signal event.
+*/
+static const QSignalTransitionPrivate *dispatchedSignalTransition(QAbstractTransition *t)
+{
+    if (t->metaObject() != &QSignalTransition::staticMetaObject)
+        return nullptr;
+    const QSignalTransitionPrivate *tp =
+            QSignalTransitionPrivate::get(static_cast<QSignalTransition *>(t));
+    return tp->signalIndex != -1 ? tp : nullptr;
+}
+
+/*
+    Returns the transitions of this state that a signal event of the given sender and signal
+    index is tested against, in the order of transitions(). A plain signal transition only
+    accepts the signal that it is registered for, so it is left out of the others.
+*/
+QList<QAbstractTransition*> QStatePrivate::transitionsForSignal(const QObject *sender,
+                                                               int signalIndex) const
+{
+    if (signalDispatchNeedsRefresh) {
+        signalDispatch.clear();
+        nonSignalTransitions.clear();
+        const QList<QAbstractTransition*> all = transitions();
+        for (QAbstractTransition *t : all) {
+            if (const QSignalTransitionPrivate *tp = dispatchedSignalTransition(t))
+                signalDispatch.insert({ tp->senderObject.valueBypassingBindings(), tp->signalIndex }, {});
+        }
+        for (QAbstractTransition *t : all) {
+            if (const QSignalTransitionPrivate *tp = dispatchedSignalTransition(t)) {
+                signalDispatch[{ tp->senderObject.valueBypassingBindings(), tp->signalIndex }].append(t);
+            } else {
+                nonSignalTransitions.append(t);
+                for (QList<QAbstractTransition*> &list : signalDispatch)
+                    list.append(t);
+            }
+        }
+        signalDispatchNeedsRefresh = false;
+    }
+    return signalDispatch.value({ sender, signalIndex }, nonSignalTransitions);
+}
+
 #ifndef QT_NO_PROPERTIES
 
 /*!
@@ -512,6 +567,15 @@ bool QState::event(QEvent *e)
     if ((e->type() == QEvent::ChildAdded) || (e->type() == QEvent::ChildRemoved)) {
         d->childStatesListNeedsRefresh = true;
         d->transitionsListNeedsRefresh = true;
+        d->signalDispatchNeedsRefresh = true;
+        // The enclosing machines number the states of nested ones, see
+        // QStateMachinePrivate::refreshDocumentOrder().
+        QStateMachine *machine = d->isMachine ? static_cast<QStateMachine *>(this) : d->machine();
+        for (QStateMachinePrivate *machinePrivate = QStateMachinePrivate::get(machine);
+             machinePrivate; machinePrivate = QStateMachinePrivate::get(machinePrivate->machine())) {
+            machinePrivate->documentOrderNeedsRefresh = true;
+            machinePrivate->transitionCacheNeedsReset = true;
+        }
         if ((e->type() == QEvent::ChildRemoved)
                 && (static_cast<QChildEvent *>(e)->child() == d->initialState.value())) {
             d->initialState.setValue(nullptr);
@@ -20,6 +20,8 @@
 
 #include <QtCore/qlist.h>
 #include <QtCore/qbytearray.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qpair.h>
 #include <QtCore/qpointer.h>
 #include <QtCore/qvariant.h>
 #include <QtCore/private/qproperty_p.h>
@@ -70,6 +72,7 @@ public:
     QList<QAbstractState*> childStates() const;
     QList<QHistoryState*> historyStates() const;
     QList<QAbstractTransition*> transitions() const;
+    QList<QAbstractTransition*> transitionsForSignal(const QObject *sender, int signalIndex) const;
 
     void emitFinished();
     void emitPropertiesAssigned();
@@ -88,10 +91,7 @@ public:
     Q_OBJECT_BINDABLE_PROPERTY_WITH_ARGS(QStatePrivate, QAbstractState*, errorState,
                                        nullptr, &QStatePrivate::errorStateChanged);
 
-    void childModeChanged()
-    {
-        emit q_func()->childModeChanged(QState::QPrivateSignal());
-    }
+    void childModeChanged();
     Q_OBJECT_BINDABLE_PROPERTY_WITH_ARGS(QStatePrivate, QState::ChildMode, childMode,
                                          QState::ExclusiveStates, &QStatePrivate::childModeChanged);
 
@@ -100,6 +100,14 @@ public:
     mutable QList<QAbstractState*> childStatesList;
     mutable QList<QAbstractTransition*> transitionsList;
 
+    // The transitions that can match a signal event, by the sender and signal index the signal
+    // transitions are registered for. Other transitions, including subclasses of QSignalTransition
+    // and unregistered ones, can match any event, so they are part of every list, and the only
+    // ones for signals that no transition is registered for.
+    mutable bool signalDispatchNeedsRefresh = true;
+    mutable QHash<QPair<const QObject *, int>, QList<QAbstractTransition *>> signalDispatch;
+    mutable QList<QAbstractTransition *> nonSignalTransitions;
+
 #ifndef QT_NO_PROPERTIES
     QList<QPropertyAssignment> propertyAssignments;
 #endif
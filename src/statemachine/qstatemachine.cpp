@@ -170,69 +170,117 @@ const int QStateMachinePrivate::FreeListDefaultConstants::Sizes[FreeListDefaultC
 // #define QSTATEMACHINE_DEBUG
 // #define QSTATEMACHINE_RESTORE_PROPERTIES_DEBUG
 
+/*
+    Results that are calculated for transitions while selecting and taking them. The exit set of
+    a transition depends on the configuration, and is only valid for the microstep in which it was
+    calculated. The effective targets and the domain of a transition that does not target a
+    history state only depend on the tree, so they are kept across microsteps until the tree
+    changes, see QStateMachinePrivate::transitionCacheNeedsReset. The cache is owned by the
+    machine, so that its entries are reused instead of being allocated for every microstep.
+*/
 struct CalculationCache {
     struct TransitionInfo {
         QList<QAbstractState*> effectiveTargetStates;
         QSet<QAbstractState*> exitSet;
         QAbstractState *transitionDomain;
+        quint64 microstep; // in which the results that are not static were calculated
 
         bool effectiveTargetStatesIsKnown: 1;
         bool exitSetIsKnown              : 1;
         bool transitionDomainIsKnown     : 1;
+        bool isStatic                    : 1; // the targets contain no history states
 
         TransitionInfo()
             : transitionDomain(nullptr)
+            , microstep(0)
             , effectiveTargetStatesIsKnown(false)
             , exitSetIsKnown(false)
             , transitionDomainIsKnown(false)
+            , isStatic(false)
         {}
     };
 
     typedef QHash<QAbstractTransition *, TransitionInfo> TransitionInfoCache;
     TransitionInfoCache cache;
+    quint64 microstep = 1;
+
+    // The atomic states of the configuration in entry order. The configuration only changes in a
+    // microstep, so all events that are tested before the next one share this list.
+    QList<QAbstractState *> atomicConfiguration;
+    quint64 atomicConfigurationMicrostep = 0;
+
+    // Forgets the results that depend on the configuration or on the history.
+    void beginMicrostep() { ++microstep; }
+
+    // Forgets everything, after the tree, the targets or the type of a transition changed.
+    void reset()
+    {
+        cache.clear();
+        ++microstep;
+    }
+
+    // Forgets a transition that is not part of the tree, before it is deleted.
+    void remove(QAbstractTransition *t) { cache.remove(t); }
+
+    const TransitionInfo *find(QAbstractTransition *t) const
+    {
+        TransitionInfoCache::const_iterator cacheIt = cache.constFind(t);
+        return cacheIt == cache.cend() ? nullptr : &*cacheIt;
+    }
+
+    bool isCurrent(const TransitionInfo &ti) const { return ti.microstep == microstep; }
+
+    TransitionInfo &entry(QAbstractTransition *t)
+    {
+        TransitionInfo &ti = cache[t];
+        if (!isCurrent(ti)) {
+            ti.exitSetIsKnown = false;
+            if (!ti.isStatic) {
+                ti.effectiveTargetStatesIsKnown = false;
+                ti.transitionDomainIsKnown = false;
+            }
+            ti.microstep = microstep;
+        }
+        return ti;
+    }
 
     bool effectiveTargetStates(QAbstractTransition *t, QList<QAbstractState *> *targets) const
     {
         Q_ASSERT(targets);
 
-        TransitionInfoCache::const_iterator cacheIt = cache.find(t);
-        if (cacheIt == cache.end() || !cacheIt->effectiveTargetStatesIsKnown)
+        const TransitionInfo *ti = find(t);
+        if (!ti || !ti->effectiveTargetStatesIsKnown || !(ti->isStatic || isCurrent(*ti)))
             return false;
 
-        *targets = cacheIt->effectiveTargetStates;
+        *targets = ti->effectiveTargetStates;
         return true;
     }
 
-    void insert(QAbstractTransition *t, const QList<QAbstractState *> &targets)
+    void insert(QAbstractTransition *t, const QList<QAbstractState *> &targets, bool isStatic)
     {
-        TransitionInfoCache::iterator cacheIt = cache.find(t);
-        TransitionInfo &ti = cacheIt == cache.end()
-                ? *cache.insert(t, TransitionInfo())
-                : *cacheIt;
+        TransitionInfo &ti = entry(t);
 
         Q_ASSERT(!ti.effectiveTargetStatesIsKnown);
         ti.effectiveTargetStates = targets;
         ti.effectiveTargetStatesIsKnown = true;
+        ti.isStatic = isStatic;
     }
 
     bool exitSet(QAbstractTransition *t, QSet<QAbstractState *> *exits) const
     {
         Q_ASSERT(exits);
 
-        TransitionInfoCache::const_iterator cacheIt = cache.find(t);
-        if (cacheIt == cache.end() || !cacheIt->exitSetIsKnown)
+        const TransitionInfo *ti = find(t);
+        if (!ti || !ti->exitSetIsKnown || !isCurrent(*ti))
             return false;
 
-        *exits = cacheIt->exitSet;
+        *exits = ti->exitSet;
         return true;
     }
 
     void insert(QAbstractTransition *t, const QSet<QAbstractState *> &exits)
     {
-        TransitionInfoCache::iterator cacheIt = cache.find(t);
-        TransitionInfo &ti = cacheIt == cache.end()
-                ? *cache.insert(t, TransitionInfo())
-                : *cacheIt;
+        TransitionInfo &ti = entry(t);
 
         Q_ASSERT(!ti.exitSetIsKnown);
         ti.exitSet = exits;
@@ -243,20 +291,17 @@ struct CalculationCache {
     {
         Q_ASSERT(domain);
 
-        TransitionInfoCache::const_iterator cacheIt = cache.find(t);
-        if (cacheIt == cache.end() || !cacheIt->transitionDomainIsKnown)
+        const TransitionInfo *ti = find(t);
+        if (!ti || !ti->transitionDomainIsKnown || !(ti->isStatic || isCurrent(*ti)))
             return false;
 
-        *domain = cacheIt->transitionDomain;
+        *domain = ti->transitionDomain;
         return true;
     }
 
     void insert(QAbstractTransition *t, QAbstractState *domain)
     {
-        TransitionInfoCache::iterator cacheIt = cache.find(t);
-        TransitionInfo &ti = cacheIt == cache.end()
-                ? *cache.insert(t, TransitionInfo())
-                : *cacheIt;
+        TransitionInfo &ti = entry(t);
 
         Q_ASSERT(!ti.transitionDomainIsKnown);
         ti.transitionDomain = domain;
@@ -292,17 +337,6 @@ static bool containsDecendantOf(const QSet<QAbstractState *> &states, const QAbs
     return false;
 }
 
-static int descendantDepth(const QAbstractState *state, const QAbstractState *ancestor)
-{
-    int depth = 0;
-    for (const QAbstractState *it = state; it != nullptr; it = it->parentState()) {
-        if (it == ancestor)
-            break;
-        ++depth;
-    }
-    return depth;
-}
-
 /* The function as described in http://www.w3.org/TR/2014/WD-scxml-20140529/ :
 
 function getProperAncestors(state1, state2)
@@ -352,9 +386,11 @@ static QList<QAbstractState *> getEffectiveTargetStates(QAbstractTransition *tra
         return targetsList;
 
     QSet<QAbstractState *> targets;
+    bool isStatic = true;
     const auto targetStates = transition->targetStates();
     for (QAbstractState *s : targetStates) {
         if (QHistoryState *historyState = QStateMachinePrivate::toHistoryState(s)) {
+            isStatic = false;
             QList<QAbstractState*> historyConfiguration = QHistoryStatePrivate::get(historyState)->configuration;
             if (!historyConfiguration.isEmpty()) {
                 // There is a saved history, so apply that.
@@ -374,7 +410,7 @@ static QList<QAbstractState *> getEffectiveTargetStates(QAbstractTransition *tra
     }
 
     targetsList = targets.values();
-    cache->insert(transition, targetsList);
+    cache->insert(transition, targetsList, isStatic);
     return targetsList;
 }
 
@@ -393,9 +429,6 @@ QStateMachinePrivate::QStateMachinePrivate()
 
 QStateMachinePrivate::~QStateMachinePrivate()
 {
-    qDeleteAll(internalEventQueue);
-    qDeleteAll(externalEventQueue);
-
     for (QHash<int, DelayedEvent>::const_iterator it = delayedEvents.cbegin(), eit = delayedEvents.cend(); it != eit; ++it) {
         delete it.value().event;
     }
@@ -406,76 +439,81 @@ QState *QStateMachinePrivate::rootState() const
     return const_cast<QStateMachine*>(q_func());
 }
 
-static int indexOfDescendant(QState *s, QAbstractState *desc)
-{
-    QList<QAbstractState*> childStates = QStatePrivate::get(s)->childStates();
-    for (int i = 0; i < childStates.size(); ++i) {
-        QAbstractState *c = childStates.at(i);
-        if ((c == desc) || isDescendant(desc, c)) {
-            return i;
+/*
+    Numbers the states and transitions below the machine in document order, which is the order of
+    a depth-first walk over the children of each state. The entry order of two states is then
+    the order of their numbers, the exit order is the reverse, and comparing them no longer walks
+    the tree. The numbers are refreshed when a state below the machine gains or loses a child.
+    A nested state machine is numbered as part of the outermost machine, as both machines compare
+    the nested machine and its transitions, and have to see the same numbers for them.
+*/
+void QStateMachinePrivate::refreshDocumentOrder()
+{
+    QStateMachinePrivate *outermost = this;
+    while (QStateMachinePrivate *enclosing = get(outermost->machine()))
+        outermost = enclosing;
+    if (!outermost->documentOrderNeedsRefresh)
+        return;
+
+    int stateOrder = 0;
+    int transitionOrder = 0;
+    const auto number = [&](const auto &self, QAbstractState *state, int depth) -> void {
+        QAbstractStatePrivate *d = QAbstractStatePrivate::get(state);
+        d->documentOrder = stateOrder++;
+        d->documentDepth = depth;
+        for (QObject *child : std::as_const(d->children)) {
+            if (QAbstractState *childState = qobject_cast<QAbstractState *>(child)) {
+                self(self, childState, depth + 1);
+            } else if (QAbstractTransition *t = qobject_cast<QAbstractTransition *>(child)) {
+                QAbstractTransitionPrivate::get(t)->documentOrder = transitionOrder++;
+            }
         }
-    }
-    return -1;
+    };
+    number(number, outermost->rootState(), 0);
+    outermost->documentOrderNeedsRefresh = false;
 }
 
-bool QStateMachinePrivate::transitionStateEntryLessThan(QAbstractTransition *t1, QAbstractTransition *t2)
+/*
+    Returns the cache for the calculations of the next microstep. Results of earlier microsteps
+    that only depend on the tree are kept, unless the tree changed since they were calculated.
+*/
+CalculationCache *QStateMachinePrivate::beginMicrostepCalculations()
 {
-    QState *s1 = t1->sourceState(), *s2 = t2->sourceState();
-    if (s1 == s2) {
-        QList<QAbstractTransition*> transitions = QStatePrivate::get(s1)->transitions();
-        return transitions.indexOf(t1) < transitions.indexOf(t2);
-    } else if (isDescendant(s1, s2)) {
-        return true;
-    } else if (isDescendant(s2, s1)) {
-        return false;
+    if (!calculationCache)
+        calculationCache.reset(new CalculationCache);
+    if (transitionCacheNeedsReset) {
+        calculationCache->reset();
+        transitionCacheNeedsReset = false;
     } else {
-        Q_ASSERT(s1->machine() != nullptr);
-        QStateMachinePrivate *mach = QStateMachinePrivate::get(s1->machine());
-        QState *lca = mach->findLCA(QList<QAbstractState*>() << s1 << s2);
-        Q_ASSERT(lca != nullptr);
-        int s1Depth = descendantDepth(s1, lca);
-        int s2Depth = descendantDepth(s2, lca);
-        if (s1Depth == s2Depth)
-            return (indexOfDescendant(lca, s1) < indexOfDescendant(lca, s2));
-        else
-            return s1Depth > s2Depth;
+        calculationCache->beginMicrostep();
     }
+    return calculationCache.data();
+}
+
+// Transitions of deeper source states come first. Transitions of states at the same depth are
+// in the document order of their source states, and then in the order they were added.
+bool QStateMachinePrivate::transitionStateEntryLessThan(QAbstractTransition *t1, QAbstractTransition *t2)
+{
+    const QAbstractStatePrivate *s1 = QAbstractStatePrivate::get(t1->sourceState());
+    const QAbstractStatePrivate *s2 = QAbstractStatePrivate::get(t2->sourceState());
+    if (s1->documentDepth != s2->documentDepth)
+        return s1->documentDepth > s2->documentDepth;
+    if (s1 != s2)
+        return s1->documentOrder < s2->documentOrder;
+    return QAbstractTransitionPrivate::get(t1)->documentOrder
+            < QAbstractTransitionPrivate::get(t2)->documentOrder;
 }
 
 bool QStateMachinePrivate::stateEntryLessThan(QAbstractState *s1, QAbstractState *s2)
 {
-    if (s1->parent() == s2->parent()) {
-        return s1->parent()->children().indexOf(s1)
-            < s2->parent()->children().indexOf(s2);
-    } else if (isDescendant(s1, s2)) {
-        return false;
-    } else if (isDescendant(s2, s1)) {
-        return true;
-    } else {
-        Q_ASSERT(s1->machine() != nullptr);
-        QStateMachinePrivate *mach = QStateMachinePrivate::get(s1->machine());
-        QState *lca = mach->findLCA(QList<QAbstractState*>() << s1 << s2);
-        Q_ASSERT(lca != nullptr);
-        return (indexOfDescendant(lca, s1) < indexOfDescendant(lca, s2));
-    }
+    return QAbstractStatePrivate::get(s1)->documentOrder
+            < QAbstractStatePrivate::get(s2)->documentOrder;
 }
 
 bool QStateMachinePrivate::stateExitLessThan(QAbstractState *s1, QAbstractState *s2)
 {
-    if (s1->parent() == s2->parent()) {
-        return s2->parent()->children().indexOf(s2)
-            < s1->parent()->children().indexOf(s1);
-    } else if (isDescendant(s1, s2)) {
-        return true;
-    } else if (isDescendant(s2, s1)) {
-        return false;
-    } else {
-        Q_ASSERT(s1->machine() != nullptr);
-        QStateMachinePrivate *mach = QStateMachinePrivate::get(s1->machine());
-        QState *lca = mach->findLCA(QList<QAbstractState*>() << s1 << s2);
-        Q_ASSERT(lca != nullptr);
-        return (indexOfDescendant(lca, s2) < indexOfDescendant(lca, s1));
-    }
+    return QAbstractStatePrivate::get(s2)->documentOrder
+            < QAbstractStatePrivate::get(s1)->documentOrder;
 }
 
 QState *QStateMachinePrivate::findLCA(const QList<QAbstractState*> &states, bool onlyCompound)
@@ -516,23 +554,36 @@ QList<QAbstractTransition*> QStateMachinePrivate::selectTransitions(QEvent *even
     Q_ASSERT(cache);
     Q_Q(const QStateMachine);
 
-    QVarLengthArray<QAbstractState *> configuration_sorted;
-    for (QAbstractState *s : std::as_const(configuration)) {
-        if (isAtomic(s))
-            configuration_sorted.append(s);
+    // The list keeps its capacity, so it is only reallocated when the configuration outgrows it.
+    QList<QAbstractState *> &configuration_sorted = cache->atomicConfiguration;
+    refreshDocumentOrder();
+    if (cache->atomicConfigurationMicrostep != cache->microstep || transitionCacheNeedsReset) {
+        configuration_sorted.clear();
+        for (QAbstractState *s : std::as_const(configuration)) {
+            if (isAtomic(s))
+                configuration_sorted.append(s);
+        }
+        std::sort(configuration_sorted.begin(), configuration_sorted.end(), stateEntryLessThan);
+        cache->atomicConfigurationMicrostep = cache->microstep;
     }
-    std::sort(configuration_sorted.begin(), configuration_sorted.end(), stateEntryLessThan);
+
+    // A signal event is only tested against the signal transitions that are registered for it.
+    const QStateMachine::SignalEvent *signalEvent = event->type() == QEvent::StateMachineSignal
+            ? static_cast<QStateMachine::SignalEvent *>(event) : nullptr;
 
     QList<QAbstractTransition*> enabledTransitions;
     const_cast<QStateMachine *>(q)->beginSelectTransitions(event);
     for (QAbstractState *state : std::as_const(configuration_sorted)) {
-        QList<QState *> lst = getProperAncestors(state, nullptr);
-        if (QState *grp = toStandardState(state))
-            lst.prepend(grp);
+        // The state itself, if it can have transitions, and then its proper ancestors.
+        QState *s = toStandardState(state);
+        if (!s)
+            s = state->parentState();
         bool found = false;
-        for (int j = 0; (j < lst.size()) && !found; ++j) {
-            QState *s = lst.at(j);
-            QList<QAbstractTransition*> transitions = QStatePrivate::get(s)->transitions();
+        for (; s && !found; s = s->parentState()) {
+            const QStatePrivate *sd = QStatePrivate::get(s);
+            const QList<QAbstractTransition*> transitions = signalEvent
+                    ? sd->transitionsForSignal(signalEvent->sender(), signalEvent->signalIndex())
+                    : sd->transitions();
             for (int k = 0; k < transitions.size(); ++k) {
                 QAbstractTransition *t = transitions.at(k);
                 if (QAbstractTransitionPrivate::get(t)->callEventTest(event)) {
@@ -590,6 +641,7 @@ void QStateMachinePrivate::removeConflictingTransitions(QList<QAbstractTransitio
 
     QList<QAbstractTransition*> filteredTransitions;
     filteredTransitions.reserve(enabledTransitions.size());
+    refreshDocumentOrder();
     std::sort(enabledTransitions.begin(), enabledTransitions.end(), transitionStateEntryLessThan);
 
     for (QAbstractTransition *t1 : std::as_const(enabledTransitions)) {
@@ -605,7 +657,7 @@ void QStateMachinePrivate::removeConflictingTransitions(QList<QAbstractTransitio
                 break;
             }
 
-            QSet<QAbstractState*> exitSetT2 = computeExitSet_Unordered(t2, cache);
+            const QSet<QAbstractState*> exitSetT2 = computeExitSet_Unordered(t2, cache);
             if (!exitSetT1.intersects(exitSetT2)) {
                 // No conflict, no cry. Next patient please.
                 ++t2It;
@@ -707,6 +759,7 @@ QList<QAbstractState*> QStateMachinePrivate::computeExitSet(const QList<QAbstrac
     Q_ASSERT(cache);
 
     QList<QAbstractState*> statesToExit_sorted = computeExitSet_Unordered(enabledTransitions, cache).values();
+    refreshDocumentOrder();
     std::sort(statesToExit_sorted.begin(), statesToExit_sorted.end(), stateExitLessThan);
     return statesToExit_sorted;
 }
@@ -846,6 +899,7 @@ QList<QAbstractState*> QStateMachinePrivate::computeEntrySet(const QList<QAbstra
     }
 
     QList<QAbstractState*> statesToEnter_sorted = statesToEnter.values();
+    refreshDocumentOrder();
     std::sort(statesToEnter_sorted.begin(), statesToEnter_sorted.end(), stateEntryLessThan);
     return statesToEnter_sorted;
 }
@@ -890,8 +944,10 @@ QAbstractState *QStateMachinePrivate::getTransitionDomain(QAbstractTransition *t
                     }
                 }
 
-                if (allDescendants)
+                if (allDescendants) {
+                    cache->insert(t, tSource);
                     return tSource;
+                }
             }
         }
     }
@@ -1765,9 +1821,7 @@ void QStateMachinePrivate::_q_start()
         abstractStatePrivate->active.setValue(false);
     }
     configuration.clear();
-    qDeleteAll(internalEventQueue);
     internalEventQueue.clear();
-    qDeleteAll(externalEventQueue);
     externalEventQueue.clear();
     clearHistory();
 
@@ -1782,7 +1836,7 @@ void QStateMachinePrivate::_q_start()
     processingScheduled = true; // we call _q_process() below
 
     QList<QAbstractTransition*> transitions;
-    CalculationCache calculationCache;
+    CalculationCache *cache = beginMicrostepCalculations();
     QAbstractTransition *initialTransition = createInitialTransition();
     transitions.append(initialTransition);
 
@@ -1790,7 +1844,7 @@ void QStateMachinePrivate::_q_start()
     executeTransitionContent(&nullEvent, transitions);
     QList<QAbstractState*> exitedStates = QList<QAbstractState*>();
     QSet<QAbstractState*> statesForDefaultEntry;
-    QList<QAbstractState*> enteredStates = computeEntrySet(transitions, statesForDefaultEntry, &calculationCache);
+    QList<QAbstractState*> enteredStates = computeEntrySet(transitions, statesForDefaultEntry, cache);
     QHash<RestorableId, QVariant> pendingRestorables;
     QHash<QAbstractState *, QList<QPropertyAssignment>> assignmentsForEnteredStates =
             computePropertyAssignments(enteredStates, pendingRestorables);
@@ -1806,6 +1860,7 @@ void QStateMachinePrivate::_q_start()
                 , selectedAnimations
 #endif
                 );
+    cache->remove(initialTransition);
     delete initialTransition;
 
 #ifdef QSTATEMACHINE_DEBUG
@@ -1840,27 +1895,32 @@ void QStateMachinePrivate::_q_process()
     qDebug() << q << ": starting the event processing loop";
 #endif
     bool didChange = false;
+    // An event that handleTransitionSignal() passed in place is not owned by the queue.
+    QEvent *const directEvent = this->directEvent;
+    const auto discard = [directEvent](QEvent *e) {
+        if (e != directEvent)
+            delete e;
+    };
     while (processing) {
         if (stop) {
             processing = false;
             break;
         }
         QList<QAbstractTransition*> enabledTransitions;
-        CalculationCache calculationCache;
+        CalculationCache *cache = beginMicrostepCalculations();
 
-        QEvent *e = new QEvent(QEvent::None);
-        enabledTransitions = selectTransitions(e, &calculationCache);
-        if (enabledTransitions.isEmpty()) {
-            delete e;
+        QEvent nullEvent(QEvent::None);
+        QEvent *e = &nullEvent;
+        enabledTransitions = selectTransitions(e, cache);
+        if (enabledTransitions.isEmpty())
             e = nullptr;
-        }
         while (enabledTransitions.isEmpty() && ((e = dequeueInternalEvent()) != nullptr)) {
 #ifdef QSTATEMACHINE_DEBUG
             qDebug() << q << ": dequeued internal event" << e << "of type" << e->type();
 #endif
-            enabledTransitions = selectTransitions(e, &calculationCache);
+            enabledTransitions = selectTransitions(e, cache);
             if (enabledTransitions.isEmpty()) {
-                delete e;
+                discard(e);
                 e = nullptr;
             }
         }
@@ -1868,7 +1928,7 @@ void QStateMachinePrivate::_q_process()
 #ifdef QSTATEMACHINE_DEBUG
                 qDebug() << q << ": dequeued external event" << e << "of type" << e->type();
 #endif
-                enabledTransitions = selectTransitions(e, &calculationCache);
+                enabledTransitions = selectTransitions(e, cache);
                 if (enabledTransitions.isEmpty()) {
                     delete e;
                     e = nullptr;
@@ -1886,14 +1946,24 @@ void QStateMachinePrivate::_q_process()
         } else {
             didChange = true;
             q->beginMicrostep(e);
-            microstep(e, enabledTransitions, &calculationCache);
+            microstep(e, enabledTransitions, cache);
             q->endMicrostep(e);
         }
-        delete e;
+        if (e != &nullEvent)
+            discard(e);
     }
 #ifdef QSTATEMACHINE_DEBUG
     qDebug() << q << ": finished the event processing loop";
 #endif
+    if (this->directEvent) {
+        // The loop was left before taking the event, so it has to outlive the emission.
+        auto *se = static_cast<QStateMachine::SignalEvent *>(this->directEvent);
+        if (state == Running && !stop) {
+            internalEventQueue.post(new QStateMachine::SignalEvent(se->sender(), se->signalIndex(),
+                                                                   se->arguments()));
+        }
+        this->directEvent = nullptr;
+    }
     if (stop) {
         stop = false;
         stopProcessingReason = Stopped;
@@ -1954,43 +2024,119 @@ void QStateMachinePrivate::_q_killDelayedEventTimer(int id, int timerId)
     delayedEventIdFreeList.release(id);
 }
 
+void QStateMachineEventQueue::post(QEvent *e)
+{
+    Node *node = m_spare.fetchAndStoreAcquire(nullptr);
+    if (!node)
+        node = new Node[1];
+    *node = Node{ e, nullptr, node };
+    push(node, node);
+}
+
+void QStateMachineEventQueue::post(const QList<QEvent *> &events)
+{
+    if (events.isEmpty())
+        return;
+
+    // Link the events most recent first, like the stack they go onto. The last event is taken
+    // last, and frees the block.
+    const qsizetype count = events.size();
+    Node *block = new Node[count];
+    for (qsizetype i = 0; i < count; ++i)
+        block[i] = Node{ events.at(i), i > 0 ? &block[i - 1] : nullptr, nullptr };
+    block[count - 1].block = block;
+    push(&block[count - 1], &block[0]);
+}
+
+void QStateMachineEventQueue::push(Node *first, Node *last)
+{
+    Node *posted = m_posted.loadRelaxed();
+    do {
+        last->next = posted;
+    } while (!m_posted.testAndSetRelease(posted, first, posted));
+}
+
+void QStateMachineEventQueue::drain()
+{
+    Node *node = m_posted.fetchAndStoreAcquire(nullptr);
+    if (!node)
+        return;
+
+    // Reverse the stack into posting order, and append it to the drained events.
+    Node *reversed = nullptr;
+    Node *last = node;
+    while (node) {
+        Node *next = node->next;
+        node->next = reversed;
+        reversed = node;
+        node = next;
+    }
+    if (m_last)
+        m_last->next = reversed;
+    else
+        m_first = reversed;
+    m_last = last;
+}
+
+QEvent *QStateMachineEventQueue::take()
+{
+    if (!m_first)
+        drain();
+    Node *node = m_first;
+    if (!node)
+        return nullptr;
+
+    m_first = node->next;
+    if (!m_first)
+        m_last = nullptr;
+    QEvent *e = node->event;
+    if (node->block == node) {
+        // A single event. Its node is kept for the next one, unless another is kept already.
+        if (!m_spare.testAndSetRelease(nullptr, node))
+            delete[] node;
+    } else if (node->block) {
+        delete[] node->block;
+    }
+    return e;
+}
+
+void QStateMachineEventQueue::clear()
+{
+    while (QEvent *e = take())
+        delete e;
+}
+
 void QStateMachinePrivate::postInternalEvent(QEvent *e)
 {
-    QMutexLocker locker(&internalEventMutex);
-    internalEventQueue.append(e);
+    internalEventQueue.post(e);
 }
 
 void QStateMachinePrivate::postExternalEvent(QEvent *e)
 {
-    QMutexLocker locker(&externalEventMutex);
-    externalEventQueue.append(e);
+    externalEventQueue.post(e);
 }
 
 QEvent *QStateMachinePrivate::dequeueInternalEvent()
 {
-    QMutexLocker locker(&internalEventMutex);
-    if (internalEventQueue.isEmpty())
-        return nullptr;
-    return internalEventQueue.takeFirst();
+    if (QEvent *e = directEvent) {
+        directEvent = nullptr;
+        return e;
+    }
+    return internalEventQueue.take();
 }
 
 QEvent *QStateMachinePrivate::dequeueExternalEvent()
 {
-    QMutexLocker locker(&externalEventMutex);
-    if (externalEventQueue.isEmpty())
-        return nullptr;
-    return externalEventQueue.takeFirst();
+    return externalEventQueue.take();
 }
 
 bool QStateMachinePrivate::isInternalEventQueueEmpty()
 {
-    QMutexLocker locker(&internalEventMutex);
-    return internalEventQueue.isEmpty();
+    return !directEvent && internalEventQueue.isEmpty();
 }
 
 bool QStateMachinePrivate::isExternalEventQueueEmpty()
 {
-    QMutexLocker locker(&externalEventMutex);
     return externalEventQueue.isEmpty();
 }
 
@@ -2271,6 +2417,8 @@ void QStateMachinePrivate::registerSignalTransition(QSignalTransition *transitio
 
     QSignalTransitionPrivate::get(transition)->signalIndex = signalIndex;
     QSignalTransitionPrivate::get(transition)->originalSignalIndex = originalSignalIndex;
+    if (QState *source = transition->sourceState())
+        QStatePrivate::get(source)->signalDispatchNeedsRefresh = true;
 #ifdef QSTATEMACHINE_DEBUG
     qDebug() << q << ": added signal transition from" << transition->sourceState()
              << ": ( sender =" << sender << ", signal =" << signal
@@ -2286,6 +2434,8 @@ void QStateMachinePrivate::unregisterSignalTransition(QSignalTransition *transit
     const QObject *sender =
             QSignalTransitionPrivate::get(transition)->senderObject.valueBypassingBindings();
     QSignalTransitionPrivate::get(transition)->signalIndex = -1;
+    if (QState *source = transition->sourceState())
+        QStatePrivate::get(source)->signalDispatchNeedsRefresh = true;
 
     connectionsMutex.lock();
     QList<int> &connectedSignalIndexes = connections[sender];
@@ -2415,6 +2565,15 @@ void QStateMachinePrivate::handleTransitionSignal(QObject *sender, int signalInd
     qDebug() << q_func() << ": sending signal event ( sender =" << sender
              << ", signal =" << method.methodSignature().constData() << ')';
 #endif
+    // An idle machine in the emitting thread takes the event before this returns, so it does not
+    // have to be allocated and queued.
+    if (state == Running && !processing && !processingScheduled && !stop
+            && QThread::currentThread() == q_func()->thread() && isInternalEventQueueEmpty()) {
+        QStateMachine::SignalEvent event(sender, signalIndex, vargs);
+        directEvent = &event;
+        _q_process();
+        return;
+    }
     postInternalEvent(new QStateMachine::SignalEvent(sender, signalIndex, vargs));
     processEvents(DirectProcessing);
 }
@@ -2734,6 +2893,49 @@ void QStateMachine::postEvent(QEvent *event, EventPriority priority)
     d->processEvents(QStateMachinePrivate::QueuedProcessing);
 }
 
+/*!
+  \threadsafe
+  \since 6.10
+
+  Posts the given \a events of the given \a priority for processing by this
+  state machine, in the order they have in the list.
+
+  This is equivalent to calling postEvent() for each of the events, except
+  that they are added to the state machine's event queue at once, so that
+  events posted from other threads cannot come between them. The state
+  machine takes ownership of the events.
+
+  \sa postEvent()
+*/
+void QStateMachine::postEvents(const QList<QEvent *> &events, EventPriority priority)
+{
+    Q_D(QStateMachine);
+    switch (d->state) {
+    case QStateMachinePrivate::Running:
+    case QStateMachinePrivate::Starting:
+        break;
+    default:
+        qWarning("QStateMachine::postEvents: cannot post events when the state machine is not running");
+        return;
+    }
+    if (events.contains(nullptr)) {
+        qWarning("QStateMachine::postEvents: cannot post null event");
+        return;
+    }
+#ifdef QSTATEMACHINE_DEBUG
+    qDebug() << this << ": posting events" << events;
+#endif
+    switch (priority) {
+    case NormalPriority:
+        d->externalEventQueue.post(events);
+        break;
+    case HighPriority:
+        d->internalEventQueue.post(events);
+        break;
+    }
+    d->processEvents(QStateMachinePrivate::QueuedProcessing);
+}
+
 /*!
   \threadsafe
 
@@ -109,6 +109,7 @@ public:
     QBindable<QState::RestorePolicy> bindableGlobalRestorePolicy();
 
     void postEvent(QEvent *event, EventPriority priority = NormalPriority);
+    void postEvents(const QList<QEvent *> &events, EventPriority priority = NormalPriority);
     int postDelayedEvent(QEvent *event, int delay);
     bool cancelDelayedEvent(int id);
 
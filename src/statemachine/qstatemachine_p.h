@@ -17,12 +17,14 @@
 
 #include "private/qstate_p.h"
 
+#include <QtCore/qatomic.h>
 #include <QtCore/qcoreevent.h>
 #include <QtCore/qhash.h>
 #include <QtCore/qlist.h>
 #include <QtCore/qmutex.h>
 #include <QtCore/qpair.h>
 #include <QtCore/qpointer.h>
+#include <QtCore/qscopedpointer.h>
 #include <QtCore/qset.h>
 
 #include <QtCore/private/qfreelist_p.h>
@@ -47,6 +49,50 @@ class QState;
 class QAbstractAnimation;
 #endif
 
+/*
+    A queue of events that any thread can post to, and that only the thread of the machine takes
+    events from. Posting pushes onto a lock-free stack. Taking moves all events on that stack, in
+    the order they were posted, to a list that only the machine's thread uses, and returns them
+    from there, so neither side ever waits for the other. The nodes of a batch of events are
+    allocated in one block, and the node of a single event is kept for the next single post.
+*/
+class QStateMachineEventQueue
+{
+    Q_DISABLE_COPY_MOVE(QStateMachineEventQueue)
+
+public:
+    QStateMachineEventQueue() = default;
+    ~QStateMachineEventQueue()
+    {
+        clear();
+        delete[] m_spare.loadAcquire();
+    }
+
+    // Thread-safe.
+    void post(QEvent *e);
+    void post(const QList<QEvent *> &events);
+
+    // Only called from the thread of the machine.
+    QEvent *take();
+    bool isEmpty() const { return !m_first && !m_posted.loadAcquire(); }
+    void clear();
+
+private:
+    struct Node {
+        QEvent *event;
+        Node *next;
+        Node *block; // the block to free once this node is taken, on the last node of a block
+    };
+
+    void push(Node *first, Node *last);
+    void drain();
+
+    QAtomicPointer<Node> m_posted; // the most recently posted event first
+    QAtomicPointer<Node> m_spare; // a block of one node, for the next single post
+    Node *m_first = nullptr; // the drained events, in posting order
+    Node *m_last = nullptr;
+};
+
 struct CalculationCache;
 class QStateMachine;
 class Q_STATEMACHINE_EXPORT QStateMachinePrivate : public QStatePrivate
@@ -77,6 +123,13 @@ public:
     QState *findLCA(const QList<QAbstractState*> &states, bool onlyCompound = false);
     QState *findLCCA(const QList<QAbstractState*> &states);
 
+    void refreshDocumentOrder();
+    CalculationCache *beginMicrostepCalculations();
+    static void invalidateTransitionCache(QStateMachine *machine)
+    {
+        if (QStateMachinePrivate *d = get(machine))
+            d->transitionCacheNeedsReset = true;
+    }
     static bool transitionStateEntryLessThan(QAbstractTransition *t1, QAbstractTransition *t2);
     static bool stateEntryLessThan(QAbstractState *s1, QAbstractState *s2);
     static bool stateExitLessThan(QAbstractState *s1, QAbstractState *s2);
@@ -213,10 +266,14 @@ public:
     bool stop;
     StopProcessingReason stopProcessingReason;
     QSet<QAbstractState*> configuration;
-    QList<QEvent*> internalEventQueue;
-    QList<QEvent*> externalEventQueue;
-    QMutex internalEventMutex;
-    QMutex externalEventMutex;
+    bool documentOrderNeedsRefresh = true;
+    // Set when a state below the machine gains or loses a child or changes its child mode, or
+    // when a transition changes its targets or type.
+    bool transitionCacheNeedsReset = false;
+    QScopedPointer<CalculationCache> calculationCache;
+    QStateMachineEventQueue internalEventQueue;
+    QStateMachineEventQueue externalEventQueue;
+    QEvent *directEvent = nullptr; // taken before the internal queue, see handleTransitionSignal()
 
     QStateMachine::Error error;
     Q_OBJECT_BINDABLE_PROPERTY_WITH_ARGS(QStateMachinePrivate, QState::RestorePolicy,
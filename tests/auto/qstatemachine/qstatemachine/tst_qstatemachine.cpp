@@ -24,6 +24,9 @@
 #include "private/qstate_p.h"
 #include "private/qstatemachine_p.h"
 
+#include <memory>
+#include <vector>
+
 static int globalTick;
 
 // Run exec for a maximum of TIMEOUT msecs
@@ -120,6 +123,8 @@ private slots:
     void assignProperty();
     void assignPropertyWithAnimation();
     void postEvent();
+    void postEvents();
+    void postEventsFromThreads();
     void cancelDelayedEvent();
     void postDelayedEventAndStop();
     void postDelayedEventFromThread();
@@ -249,6 +254,12 @@ private slots:
     void postDelayedEventWithChronoFromThread();
     void bindings();
     void severalStateMachinesInParallelState();
+    void documentOrderFollowsTreeChanges();
+    void documentOrderOfNestedMachines();
+    void transitionDomainFollowsTransitionChanges();
+    void signalTransitionTakenDuringEmission();
+    void signalEventReachesOtherTransitions();
+    void signalEventReachesSignalTransitionSubclasses();
 };
 
 class TestState : public QState
@@ -1804,6 +1815,85 @@ void tst_QStateMachine::postEvent()
     }
 }
 
+void tst_QStateMachine::postEvents()
+{
+    QStateMachine machine;
+    {
+        QEvent e(QEvent::None);
+        QTest::ignoreMessage(QtWarningMsg, "QStateMachine::postEvents: cannot post events when the state machine is not running");
+        machine.postEvents({ &e });
+    }
+    QState *s1 = new QState(&machine);
+    QState *s2 = new QState(&machine);
+    QFinalState *s3 = new QFinalState(&machine);
+    s1->addTransition(new StringTransition("a", s2));
+    s2->addTransition(new StringTransition("b", s3));
+    machine.setInitialState(s1);
+    QSignalSpy finishedSpy(&machine, &QStateMachine::finished);
+
+    machine.start();
+    QTRY_VERIFY(machine.configuration().contains(s1));
+
+    QTest::ignoreMessage(QtWarningMsg, "QStateMachine::postEvents: cannot post null event");
+    machine.postEvents({ nullptr });
+
+    // The events are processed in the order of the list.
+    machine.postEvents({ new StringEvent("a"), new StringEvent("b") });
+    QTRY_COMPARE(finishedSpy.size(), 1);
+    QCOMPARE(machine.configuration(), QSet<QAbstractState *>({ s3 }));
+}
+
+class StringRecorder : public QAbstractTransition
+{
+public:
+    QStringList values;
+
+protected:
+    bool eventTest(QEvent *e) override { return e->type() == QEvent::Type(QEvent::User + 2); }
+    void onTransition(QEvent *e) override { values.append(static_cast<StringEvent *>(e)->value); }
+};
+
+void tst_QStateMachine::postEventsFromThreads()
+{
+    QStateMachine machine;
+    QState *s1 = new QState(&machine);
+    StringRecorder *recorder = new StringRecorder;
+    s1->addTransition(recorder);
+    machine.setInitialState(s1);
+    machine.start();
+    QTRY_VERIFY(machine.configuration().contains(s1));
+
+    // Each thread posts single events and batches in turn, while the others do the same.
+    enum { ThreadCount = 4, RoundCount = 250, BatchSize = 3 };
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int t = 0; t < ThreadCount; ++t) {
+        threads.emplace_back(QThread::create([&machine, t]() {
+            int i = 0;
+            for (int round = 0; round < RoundCount; ++round) {
+                machine.postEvent(new StringEvent(QString("%1.%2").arg(t).arg(i++)));
+                QList<QEvent *> batch;
+                for (int k = 0; k < BatchSize; ++k)
+                    batch.append(new StringEvent(QString("%1.%2").arg(t).arg(i++)));
+                machine.postEvents(batch);
+            }
+        }));
+        threads.back()->start();
+    }
+    for (const auto &thread : threads)
+        QVERIFY(thread->wait());
+
+    // No event is lost, and the events of each thread keep their order.
+    const int eventCount = RoundCount * (1 + BatchSize);
+    QTRY_COMPARE(recorder->values.size(), ThreadCount * eventCount);
+    QList<int> next(ThreadCount, 0);
+    for (const QString &value : std::as_const(recorder->values)) {
+        const int t = value.section(QLatin1Char('.'), 0, 0).toInt();
+        QCOMPARE(value.section(QLatin1Char('.'), 1).toInt(), next[t]++);
+    }
+    for (int t = 0; t < ThreadCount; ++t)
+        QCOMPARE(next.at(t), eventCount);
+}
+
 void tst_QStateMachine::cancelDelayedEvent()
 {
     QStateMachine machine;
@@ -7107,5 +7197,218 @@ void tst_QStateMachine::severalStateMachinesInParallelState()
 
 }
 
+void tst_QStateMachine::documentOrderFollowsTreeChanges()
+{
+    QStateMachine machine;
+    QState *group = new QState(QState::ParallelStates, &machine);
+    group->setObjectName("group");
+    QState *a = new QState(group);
+    a->setObjectName("a");
+    QState *b = new QState(group);
+    b->setObjectName("b");
+    machine.setInitialState(group);
+
+    QStringList entered;
+    const auto recordEntry = [&entered](QAbstractState *state) {
+        QObject::connect(state, &QAbstractState::entered, state, [&entered, state] {
+            entered.append(state->objectName());
+        });
+    };
+    recordEntry(group);
+    recordEntry(a);
+    recordEntry(b);
+
+    QSignalSpy stoppedSpy(&machine, &QStateMachine::stopped);
+    machine.start();
+    QTRY_COMPARE(entered, QStringList({ "group", "a", "b" }));
+    machine.stop();
+    QTRY_COMPARE(stoppedSpy.size(), 1);
+
+    // Adding a state and moving another one to the end changes the document order.
+    QState *c = new QState(group);
+    c->setObjectName("c");
+    recordEntry(c);
+    a->setParent(nullptr);
+    a->setParent(group);
+
+    entered.clear();
+    machine.start();
+    QTRY_COMPARE(entered, QStringList({ "group", "b", "c", "a" }));
+}
+
+void tst_QStateMachine::documentOrderOfNestedMachines()
+{
+    QStateMachine machine;
+    QState *group = new QState(QState::ParallelStates, &machine);
+    QStateMachine *nested = new QStateMachine(group);
+    QState *nestedState = new QState(nested);
+    nested->setInitialState(nestedState);
+    QState *sibling = new QState(group);
+    QState *fromNested = new QState(&machine);
+    QState *fromSibling = new QState(&machine);
+    machine.setInitialState(group);
+
+    sibling->addTransition(new EventTransition(QEvent::User, fromSibling));
+
+    machine.start();
+    QTRY_VERIFY(nested->isRunning());
+    QVERIFY(machine.configuration().contains(sibling));
+
+    // The transition is added while both machines run. Both transitions are enabled by the same
+    // event and exit the group, so the one of the state that comes first in the document wins,
+    // even though the nested machine numbers its own states as well.
+    nested->addTransition(new EventTransition(QEvent::User, fromNested));
+    QCoreApplication::processEvents();
+    machine.postEvent(new QEvent(QEvent::User));
+    QTRY_VERIFY(machine.configuration().contains(fromNested));
+    QVERIFY(!machine.configuration().contains(fromSibling));
+}
+
+void tst_QStateMachine::transitionDomainFollowsTransitionChanges()
+{
+    QStateMachine machine;
+    QState *p = new QState(&machine);
+    QState *s1 = new QState(p);
+    QState *s2 = new QState(p);
+    p->setInitialState(s1);
+    QState *q = new QState(&machine);
+    machine.setInitialState(p);
+
+    EventTransition *forward = new EventTransition(QEvent::Type(QEvent::User + 1), s2, s1);
+    new EventTransition(QEvent::Type(QEvent::User + 2), s1, s2);
+    EventTransition *toS2 = new EventTransition(QEvent::Type(QEvent::User + 3), s2, p);
+    QSignalSpy pEnteredSpy(p, &QState::entered);
+
+    machine.start();
+    QTRY_VERIFY(machine.configuration().contains(s1));
+    QCOMPARE(pEnteredSpy.size(), 1);
+
+    // Take the transitions once, so that their domains are known to the machine.
+    machine.postEvent(new QEvent(QEvent::Type(QEvent::User + 1)));
+    QTRY_VERIFY(machine.configuration().contains(s2));
+    machine.postEvent(new QEvent(QEvent::Type(QEvent::User + 3)));
+    QTRY_COMPARE(pEnteredSpy.size(), 2);
+    machine.postEvent(new QEvent(QEvent::Type(QEvent::User + 2)));
+    QTRY_VERIFY(machine.configuration().contains(s1));
+
+    // An internal transition does not leave its source state.
+    toS2->setTransitionType(QAbstractTransition::InternalTransition);
+    machine.postEvent(new QEvent(QEvent::Type(QEvent::User + 3)));
+    QTRY_VERIFY(machine.configuration().contains(s2));
+    QCOMPARE(pEnteredSpy.size(), 2);
+    machine.postEvent(new QEvent(QEvent::Type(QEvent::User + 2)));
+    QTRY_VERIFY(machine.configuration().contains(s1));
+
+    // A new target outside of the parent moves the domain up to the machine.
+    forward->setTargetState(q);
+    machine.postEvent(new QEvent(QEvent::Type(QEvent::User + 1)));
+    QTRY_VERIFY(machine.configuration().contains(q));
+    QVERIFY(!machine.configuration().contains(p));
+}
+
+void tst_QStateMachine::signalTransitionTakenDuringEmission()
+{
+    QStateMachine machine;
+    SignalEmitter emitter;
+    QState *s0 = new QState(&machine);
+    QState *s1 = new QState(&machine);
+    QState *s2 = new QState(&machine);
+    TestSignalTransition *first = new TestSignalTransition(&emitter, SIGNAL(signalWithIntArg(int)), s1);
+    s0->addTransition(first);
+    TestSignalTransition *second = new TestSignalTransition(&emitter, SIGNAL(signalWithIntArg(int)), s2);
+    s1->addTransition(second);
+    // The emission from inside the machine is queued, and taken in the same macrostep.
+    connect(s1, &QState::entered, &emitter, [&emitter] { emitter.emitSignalWithIntArg(2); });
+    machine.setInitialState(s0);
+    machine.start();
+    QTRY_VERIFY(machine.configuration().contains(s0));
+
+    emitter.emitSignalWithIntArg(1);
+    QCOMPARE(machine.configuration(), QSet<QAbstractState *>({ s2 }));
+    QCOMPARE(first->transitionArgumentsReceived(), QVariantList({ 1 }));
+    QCOMPARE(second->transitionArgumentsReceived(), QVariantList({ 2 }));
+}
+
+class AnySignalTransition : public QAbstractTransition
+{
+public:
+    AnySignalTransition(QAbstractState *target)
+    { setTargetState(target); }
+protected:
+    bool eventTest(QEvent *e) override
+    { return e->type() == QEvent::StateMachineSignal; }
+    void onTransition(QEvent *) override {}
+};
+
+void tst_QStateMachine::signalEventReachesOtherTransitions()
+{
+    QStateMachine machine;
+    SignalEmitter emitter;
+    QState *p = new QState(&machine);
+    QState *s0 = new QState(p);
+    QState *s1 = new QState(p);
+    QState *s2 = new QState(p);
+    p->setInitialState(s0);
+    machine.setInitialState(p);
+    // Signal events are only generated for signals that a signal transition is registered for.
+    p->addTransition(&emitter, &SignalEmitter::signalWithStringArg, s1);
+    s0->addTransition(&emitter, &SignalEmitter::signalWithIntArg, s1);
+    s0->addTransition(new AnySignalTransition(s2));
+    s2->addTransition(&emitter, &SignalEmitter::signalWithIntArg, s0);
+    machine.start();
+    QTRY_VERIFY(machine.configuration().contains(s0));
+
+    // The signal transition of s0 does not match, but the other transition does.
+    emitter.emitSignalWithStringArg(QStringLiteral("a"));
+    QTRY_VERIFY(machine.configuration().contains(s2));
+
+    emitter.emitSignalWithIntArg(1);
+    QTRY_VERIFY(machine.configuration().contains(s0));
+
+    // The signal transition comes first.
+    emitter.emitSignalWithIntArg(2);
+    QTRY_VERIFY(machine.configuration().contains(s1));
+}
+
+class AnySignalSignalTransition : public QSignalTransition
+{
+    Q_OBJECT
+public:
+    AnySignalSignalTransition(QAbstractState *target)
+    { setTargetState(target); }
+    AnySignalSignalTransition(const QObject *sender, const char *signal, QAbstractState *target)
+        : QSignalTransition(sender, signal)
+    { setTargetState(target); }
+protected:
+    bool eventTest(QEvent *e) override
+    { return e->type() == QEvent::StateMachineSignal; }
+};
+
+void tst_QStateMachine::signalEventReachesSignalTransitionSubclasses()
+{
+    QStateMachine machine;
+    SignalEmitter emitter;
+    QState *p = new QState(&machine);
+    QState *s0 = new QState(p);
+    QState *s1 = new QState(p);
+    QState *s2 = new QState(p);
+    p->setInitialState(s0);
+    machine.setInitialState(p);
+    // Signal events are only generated for signals that a signal transition is registered for.
+    p->addTransition(&emitter, &SignalEmitter::signalWithStringArg, s0);
+    // A subclass that is registered for another signal, and one that is not registered at all,
+    // both reimplement eventTest() to accept any signal.
+    s0->addTransition(new AnySignalSignalTransition(&emitter, SIGNAL(signalWithIntArg(int)), s1));
+    s1->addTransition(new AnySignalSignalTransition(s2));
+    machine.start();
+    QTRY_VERIFY(machine.configuration().contains(s0));
+
+    emitter.emitSignalWithStringArg(QStringLiteral("a"));
+    QTRY_VERIFY(machine.configuration().contains(s1));
+
+    emitter.emitSignalWithStringArg(QStringLiteral("b"));
+    QTRY_VERIFY(machine.configuration().contains(s2));
+}
+
 QTEST_MAIN(tst_QStateMachine)
 #include "tst_qstatemachine.moc"
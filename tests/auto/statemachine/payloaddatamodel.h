@@ -0,0 +1,35 @@
+// Copyright (C) 2026 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only
+
+#ifndef PAYLOADDATAMODEL_H
+#define PAYLOADDATAMODEL_H
+
+#include <QtScxml/qscxmlcppdatamodel.h>
+
+// Sent as the data of an event, without converting it to a QVariantMap.
+struct Reading
+{
+    int value = 0;
+    QString unit;
+};
+
+class PayloadDataModel : public QScxmlCppDataModel
+{
+    Q_OBJECT
+    Q_SCXML_DATAMODEL
+
+public:
+    Reading lastReading;
+
+private:
+    bool acceptReading()
+    {
+        const Reading *reading = eventPayload<Reading>();
+        if (!reading)
+            return false;
+        lastReading = *reading;
+        return true;
+    }
+};
+
+#endif // PAYLOADDATAMODEL_H
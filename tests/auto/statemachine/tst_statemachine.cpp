@@ -8,13 +8,75 @@
 #include <QtScxml/qscxmlcompiler.h>
 #include <QtScxml/qscxmlstatemachine.h>
 #include <QtScxml/qscxmlinvokableservice.h>
+#include <QtScxml/private/qscxmlbinarytable_p.h>
 #include <QtScxml/private/qscxmlstatemachine_p.h>
 #include <QtScxml/QScxmlNullDataModel>
 
+#include "payloadmachine.h"
 #include "topmachine.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+
 enum { SpyWaitTime = 8000 };
 
+// Counts the allocations done through malloc(), calloc() and realloc() while an AllocationCounter
+// exists. This includes operator new and the storage of Qt's containers and strings. The functions
+// can only be interposed where the C library provides the underlying ones under a second name.
+#if defined(__GLIBC__)
+#  define COUNT_ALLOCATIONS
+#endif
+
+#ifdef COUNT_ALLOCATIONS
+static QBasicAtomicInt countAllocations = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt allocationCount = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+static inline void countAllocation()
+{
+    if (countAllocations.loadRelaxed())
+        allocationCount.fetchAndAddRelaxed(1);
+}
+
+extern "C" {
+void *__libc_malloc(std::size_t size) noexcept;
+void *__libc_calloc(std::size_t count, std::size_t size) noexcept;
+void *__libc_realloc(void *ptr, std::size_t size) noexcept;
+
+void *malloc(std::size_t size) noexcept
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) noexcept
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, std::size_t size) noexcept
+{
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+}
+
+class AllocationCounter
+{
+public:
+    AllocationCounter()
+    {
+        allocationCount.storeRelaxed(0);
+        countAllocations.storeRelaxed(1);
+    }
+    ~AllocationCounter() { countAllocations.storeRelaxed(0); }
+
+    int count() const { return allocationCount.loadRelaxed(); }
+};
+#endif // COUNT_ALLOCATIONS
+
 class tst_StateMachine: public QObject
 {
     Q_OBJECT
@@ -41,6 +103,18 @@ private Q_SLOTS:
     void bindings();
 
     void setTableDataUpdatesObjectNames();
+
+    void steadyStateDoesNotAllocate();
+    void delayedEvents();
+    void submitEventFromAnyThread();
+    void submitEventsAndProcessUntilStable();
+    void sharedTables();
+    void invokedTables();
+    void binaryTable();
+    void typedPayload();
+    void compiledPayload();
+    void ecmaScriptEvent();
+    void ecmaScriptExpressions();
 };
 
 void tst_StateMachine::stateNames_data()
@@ -594,6 +668,555 @@ void tst_StateMachine::setTableDataUpdatesObjectNames()
     QCOMPARE_EQ(sm->objectName(), sm1ObjectName); // did not change
 }
 
+void tst_StateMachine::steadyStateDoesNotAllocate()
+{
+#ifndef COUNT_ALLOCATIONS
+    QSKIP("Allocations can only be counted with glibc.");
+#else
+    QScopedPointer<QScxmlStateMachine> stateMachine(
+                QScxmlStateMachine::fromFile(QString(":/tst_statemachine/steadystate.scxml")));
+    QVERIFY(!stateMachine.isNull());
+    QVERIFY(stateMachine->parseErrors().isEmpty());
+    stateMachine->start();
+    QTRY_VERIFY(stateMachine->isActive("a1") && stateMachine->isActive("b1"));
+
+    // Creating and queueing the event allocates, only processing it is checked.
+    QScxmlStateMachinePrivate *smp = QScxmlStateMachinePrivate::get(stateMachine.data());
+    const auto step = [&](const QString &eventName) {
+        stateMachine->submitEvent(eventName);
+        AllocationCounter counter;
+        smp->processEvents();
+        return counter.count();
+    };
+
+    // Let the reused buffers, the queues and the recorded history grow to their working size.
+    for (int i = 0; i < 4; ++i) {
+        step("toggle");
+        step("reenter");
+    }
+
+    int allocations = 0;
+    for (int i = 0; i < 16; ++i) {
+        allocations += step("toggle");
+        allocations += step("reenter");
+    }
+    QCOMPARE(allocations, 0);
+
+    // "toggle" moves both regions, "reenter" resets a and restores b from its history.
+    QVERIFY(stateMachine->isActive("a1"));
+    QVERIFY(stateMachine->isActive("b1"));
+#endif
+}
+
+void tst_StateMachine::delayedEvents()
+{
+    QScopedPointer<QScxmlStateMachine> stateMachine(
+                QScxmlStateMachine::fromFile(QString(":/tst_statemachine/delayedevents.scxml")));
+    QVERIFY(!stateMachine.isNull());
+    QVERIFY(stateMachine->parseErrors().isEmpty());
+    stateMachine->start();
+    QTRY_VERIFY(stateMachine->isActive("waiting"));
+
+    QStringList received;
+    auto con = stateMachine->connectToEvent("delayed.*", [&received](const QScxmlEvent &event) {
+        received.append(event.name().section(QLatin1Char('.'), 1));
+    });
+    QVERIFY(con);
+
+    // An event can be cancelled while earlier ones have already been delivered.
+    const auto cancel = [&stateMachine](const QScxmlEvent &) {
+        stateMachine->cancelDelayedEvent("d");
+    };
+    auto cancelCon = stateMachine->connectToEvent("delayed.a", cancel);
+    QVERIFY(cancelCon);
+
+    const auto submitDelayed = [&](const QString &name, const QString &sendId, int delay) {
+        QScxmlEvent *event = new QScxmlEvent;
+        event->setName("delayed." + name);
+        event->setSendId(sendId);
+        event->setDelay(delay);
+        stateMachine->submitEvent(event);
+    };
+
+    // Events are delivered in order of their due time, and in submission order if equal.
+    submitDelayed("c", "c", 300);
+    submitDelayed("a", "a", 100);
+    submitDelayed("cancelled", "cancelled", 50);
+    submitDelayed("b", "b", 200);
+    submitDelayed("d", "d", 300);
+    submitDelayed("e", "e", 400);
+
+    // Events without a send ID cannot be cancelled, but are delivered like the others.
+    QStringList anonymous;
+    for (int i = 0; i < 100; ++i) {
+        anonymous.append(QString::number(i));
+        submitDelayed(anonymous.last(), QString(), 250);
+    }
+
+    stateMachine->cancelDelayedEvent("cancelled");
+    stateMachine->cancelDelayedEvent("unknown");
+    stateMachine->cancelDelayedEvent(QString());
+    QVERIFY(received.isEmpty());
+
+    // "e" is the last event that is due.
+    QTRY_VERIFY(stateMachine->isActive("done"));
+    QCOMPARE(received, QStringList({ "a", "b" }) + anonymous + QStringList({ "c", "e" }));
+}
+
+void tst_StateMachine::submitEventFromAnyThread()
+{
+    QScopedPointer<QScxmlStateMachine> stateMachine(
+                QScxmlStateMachine::fromFile(QString(":/tst_statemachine/concurrentevents.scxml")));
+    QVERIFY(!stateMachine.isNull());
+    QVERIFY(stateMachine->parseErrors().isEmpty());
+    stateMachine->start();
+    QTRY_VERIFY(stateMachine->isActive("listening"));
+
+    enum { ThreadCount = 4, EventCount = 1000 };
+    QList<QList<int>> received(ThreadCount);
+    auto con = stateMachine->connectToEvent("thread.*", [&received](const QScxmlEvent &event) {
+        const QStringList segments = event.name().split(QLatin1Char('.'));
+        received[segments.at(1).toInt()].append(segments.at(2).toInt());
+    });
+    QVERIFY(con);
+
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int t = 0; t < ThreadCount; ++t) {
+        threads.emplace_back(QThread::create([&stateMachine, t]() {
+            for (int i = 0; i < EventCount; ++i) {
+                QScxmlEvent *event = new QScxmlEvent;
+                event->setName(QString("thread.%1.%2").arg(t).arg(i));
+                stateMachine->submitEventFromAnyThread(event);
+            }
+        }));
+        threads.back()->start();
+    }
+    for (const auto &thread : threads)
+        QVERIFY(thread->wait());
+
+    // The call that picks up the events also processes them, without another round trip through
+    // the event loop. Events posted while sending are left for the next call.
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::MetaCall);
+
+    // The events of each thread arrive complete and in order.
+    QList<int> expected;
+    for (int i = 0; i < EventCount; ++i)
+        expected.append(i);
+    for (int t = 0; t < ThreadCount; ++t)
+        QCOMPARE(received.at(t), expected);
+}
+
+void tst_StateMachine::submitEventsAndProcessUntilStable()
+{
+    QScopedPointer<QScxmlStateMachine> stateMachine(
+                QScxmlStateMachine::fromFile(QString(":/tst_statemachine/batchedevents.scxml")));
+    QVERIFY(!stateMachine.isNull());
+    QVERIFY(stateMachine->parseErrors().isEmpty());
+    stateMachine->start();
+    QTRY_VERIFY(stateMachine->isActive("first"));
+
+    QStringList processed;
+    auto con = stateMachine->connectToEvent("*", [&processed](const QScxmlEvent &event) {
+        processed.append(event.name());
+    });
+    QVERIFY(con);
+
+    QSignalSpy stableSpy(stateMachine.data(), &QScxmlStateMachine::reachedStableState);
+    const QStringList names({ "next", "next", "back", "next" });
+    std::vector<QScxmlEvent *> events;
+    for (const QString &name : names) {
+        QScxmlEvent *event = new QScxmlEvent;
+        event->setName(name);
+        events.push_back(event);
+    }
+    stateMachine->submitEvents(events);
+    QVERIFY(processed.isEmpty());
+    QVERIFY(stateMachine->isActive("first"));
+
+    // The whole batch runs synchronously and in order, in one macrostep loop. "back" is only
+    // taken after both "next" events.
+    stateMachine->processUntilStable();
+    QCOMPARE(processed, names);
+    QVERIFY(stateMachine->isActive("second"));
+    QCOMPARE(stableSpy.size(), 1);
+
+    // The call queued by submitting the events does not process anything anymore.
+    QCoreApplication::processEvents();
+    QCOMPARE(stableSpy.size(), 1);
+    QCOMPARE(processed, names);
+}
+
+void tst_StateMachine::sharedTables()
+{
+    const QString fileName(":/tst_statemachine/sharedtables.scxml");
+    QScopedPointer<QScxmlStateMachine> stateMachine1(QScxmlStateMachine::fromFile(fileName));
+    QScopedPointer<QScxmlStateMachine> stateMachine2(QScxmlStateMachine::fromFile(fileName));
+    QVERIFY(!stateMachine1.isNull());
+    QVERIFY(!stateMachine2.isNull());
+    QVERIFY(stateMachine1->parseErrors().isEmpty());
+    QVERIFY(stateMachine2->parseErrors().isEmpty());
+
+    // Machines created from the same document share their tables, but not their state.
+    QCOMPARE(stateMachine1->tableData(), stateMachine2->tableData());
+    QCOMPARE(stateMachine1->metaObject(), stateMachine2->metaObject());
+    QVERIFY(stateMachine1->dataModel() != stateMachine2->dataModel());
+
+    stateMachine1->start();
+    stateMachine2->start();
+    QTRY_VERIFY(stateMachine1->isActive("off") && stateMachine2->isActive("off"));
+    stateMachine1->submitEvent("toggle");
+    QTRY_VERIFY(stateMachine1->isActive("on"));
+    QVERIFY(stateMachine2->isActive("off"));
+    QCOMPARE(stateMachine1->property("on").toBool(), true);
+    QCOMPARE(stateMachine2->property("on").toBool(), false);
+
+    // The tables outlive the machine that created them.
+    stateMachine1.reset();
+    stateMachine2->submitEvent("toggle");
+    QTRY_VERIFY(stateMachine2->isActive("on"));
+
+    // Other documents get their own tables.
+    QScopedPointer<QScxmlStateMachine> other(
+                QScxmlStateMachine::fromFile(QString(":/tst_statemachine/statenames.scxml")));
+    QVERIFY(other->tableData() != stateMachine2->tableData());
+
+    // Documents that load external content are compiled for each machine, as the content may
+    // have changed in between.
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath("external.scxml");
+    QByteArray document("<scxml xmlns=\"http://www.w3.org/2005/07/scxml\" version=\"1.0\""
+                        " datamodel=\"ecmascript\" initial=\"s\">"
+                        "<datamodel><data id=\"value\" expr=\"0\"/></datamodel>"
+                        "<script src=\"value.js\"/>"
+                        "<state id=\"s\"/>"
+                        "</scxml>");
+    const auto startExternal = [&](const QByteArray &script) -> QScxmlStateMachine * {
+        QFile scriptFile(dir.filePath("value.js"));
+        if (!scriptFile.open(QIODevice::WriteOnly) || scriptFile.write(script) != script.size())
+            return nullptr;
+        scriptFile.close();
+
+        QBuffer buffer(&document);
+        buffer.open(QIODevice::ReadOnly);
+        std::unique_ptr<QScxmlStateMachine> stateMachine(
+                    QScxmlStateMachine::fromData(&buffer, fileName));
+        if (!stateMachine || !stateMachine->parseErrors().isEmpty())
+            return nullptr;
+        stateMachine->start();
+        if (!QTest::qWaitFor([&stateMachine]() { return stateMachine->isActive("s"); },
+                             SpyWaitTime)) {
+            return nullptr;
+        }
+        return stateMachine.release();
+    };
+
+    QScopedPointer<QScxmlStateMachine> external1(startExternal("value = 1;"));
+    QScopedPointer<QScxmlStateMachine> external2(startExternal("value = 2;"));
+    QVERIFY(external1);
+    QVERIFY(external2);
+    QVERIFY(external1->tableData() != external2->tableData());
+    QCOMPARE(external1->dataModel()->scxmlProperty("value").toInt(), 1);
+    QCOMPARE(external2->dataModel()->scxmlProperty("value").toInt(), 2);
+}
+
+void tst_StateMachine::invokedTables()
+{
+    class DocumentLoader : public QScxmlCompiler::Loader
+    {
+    public:
+        QByteArray load(const QString &name, const QString &, QStringList *errors) override
+        {
+            if (!documents.contains(name))
+                errors->append(QStringLiteral("no document %1").arg(name));
+            return documents.value(name);
+        }
+
+        QHash<QString, QByteArray> documents;
+    };
+
+    static const char childTemplate[] =
+            "<scxml xmlns=\"http://www.w3.org/2005/07/scxml\" version=\"1.0\" initial=\"%1\">"
+            "<state id=\"%1\"/>"
+            "</scxml>";
+    DocumentLoader loader1;
+    loader1.documents.insert("child.scxml", QString::fromLatin1(childTemplate).arg("one").toUtf8());
+    DocumentLoader loader2;
+    loader2.documents.insert("child.scxml", QString::fromLatin1(childTemplate).arg("two").toUtf8());
+
+    QByteArray parentDocument(
+                "<scxml xmlns=\"http://www.w3.org/2005/07/scxml\" version=\"1.0\""
+                " datamodel=\"ecmascript\" initial=\"s\">"
+                "<state id=\"s\"><invoke srcexpr=\"'child.scxml'\"/></state>"
+                "</scxml>");
+    // Returns the invoked child, which is owned by the returned parent.
+    const auto startParent = [&](QScxmlCompiler::Loader *loader,
+                                 QScxmlStateMachine **child) -> QScxmlStateMachine * {
+        QBuffer buffer(&parentDocument);
+        buffer.open(QIODevice::ReadOnly);
+        std::unique_ptr<QScxmlStateMachine> parent(
+                    QScxmlStateMachine::fromData(&buffer, QStringLiteral("parent.scxml")));
+        if (!parent || !parent->parseErrors().isEmpty())
+            return nullptr;
+        parent->setLoader(loader);
+        parent->start();
+        if (!QTest::qWaitFor([&parent]() { return parent->invokedServices().size() == 1; },
+                             SpyWaitTime)) {
+            return nullptr;
+        }
+        *child = qvariant_cast<QScxmlStateMachine *>(
+                    parent->invokedServices().first()->property("stateMachine"));
+        return *child ? parent.release() : nullptr;
+    };
+
+    // The same document is compiled once.
+    QScxmlStateMachine *child1 = nullptr;
+    QScxmlStateMachine *child2 = nullptr;
+    QScopedPointer<QScxmlStateMachine> parent1(startParent(&loader1, &child1));
+    QScopedPointer<QScxmlStateMachine> parent2(startParent(&loader1, &child2));
+    QVERIFY(parent1);
+    QVERIFY(parent2);
+    QCOMPARE(child1->tableData(), child2->tableData());
+    QTRY_VERIFY(child2->isActive("one"));
+
+    // Another loader returns another document for the same URL.
+    QScxmlStateMachine *child3 = nullptr;
+    QScopedPointer<QScxmlStateMachine> parent3(startParent(&loader2, &child3));
+    QVERIFY(parent3);
+    QVERIFY(child3->tableData() != child1->tableData());
+    QTRY_VERIFY(child3->isActive("two"));
+
+    // The document changes, and is compiled again.
+    loader1.documents.insert("child.scxml",
+                             QString::fromLatin1(childTemplate).arg("three").toUtf8());
+    QScxmlStateMachine *child4 = nullptr;
+    QScopedPointer<QScxmlStateMachine> parent4(startParent(&loader1, &child4));
+    QVERIFY(parent4);
+    QVERIFY(child4->tableData() != child1->tableData());
+    QVERIFY(child4->tableData() != child3->tableData());
+    QTRY_VERIFY(child4->isActive("three"));
+}
+
+void tst_StateMachine::binaryTable()
+{
+    QFile scxmlFile(":/tst_statemachine/steadystate.scxml");
+    QVERIFY(scxmlFile.open(QIODevice::ReadOnly));
+    QXmlStreamReader reader(&scxmlFile);
+    QScxmlCompiler compiler(&reader);
+    std::unique_ptr<QScxmlStateMachine> compiled(compiler.compile());
+    QVERIFY(compiler.errors().isEmpty());
+
+    QString errorMessage;
+    const QByteArray table = QScxmlInternal::BinaryTable::write(
+                QScxmlCompilerPrivate::get(&compiler)->scxmlDocument(), &errorMessage);
+    QVERIFY2(!table.isEmpty(), qPrintable(errorMessage));
+
+    QTemporaryFile binaryFile;
+    QVERIFY(binaryFile.open());
+    QCOMPARE(binaryFile.write(table), table.size());
+    binaryFile.close();
+
+    QScopedPointer<QScxmlStateMachine> stateMachine(
+                QScxmlStateMachine::fromFile(binaryFile.fileName()));
+    QCOMPARE(stateMachine->parseErrors().size(), 0);
+    QCOMPARE(stateMachine->stateNames(false), compiled->stateNames(false));
+    QCOMPARE(stateMachine->objectName(), compiled->objectName());
+
+    stateMachine->start();
+    QTRY_VERIFY(stateMachine->isActive("a1"));
+    QVERIFY(stateMachine->isActive("b1"));
+    stateMachine->submitEvent("toggle");
+    QTRY_VERIFY(stateMachine->isActive("a2"));
+    QVERIFY(stateMachine->isActive("b2"));
+    QCOMPARE(stateMachine->property("a2").toBool(), true);
+
+    // A damaged table is reported like a document that does not parse.
+    QByteArray damaged = table;
+    damaged.truncate(damaged.size() / 2);
+    QVERIFY(binaryFile.open());
+    binaryFile.resize(0);
+    binaryFile.write(damaged);
+    binaryFile.close();
+    QScopedPointer<QScxmlStateMachine> invalid(
+                QScxmlStateMachine::fromFile(binaryFile.fileName()));
+    QCOMPARE(invalid->parseErrors().size(), 1);
+
+    // So is damage inside the table. Each word of a table with executable content is overwritten
+    // in turn. Whatever is accepted has to be instantiated without referring to anything that
+    // does not exist, which decodes all executable content.
+    QFile codeFile(":/tst_statemachine/eventoccurred.scxml");
+    QVERIFY(codeFile.open(QIODevice::ReadOnly));
+    QXmlStreamReader codeReader(&codeFile);
+    QScxmlCompiler codeCompiler(&codeReader);
+    std::unique_ptr<QScxmlStateMachine> codeCompiled(codeCompiler.compile());
+    QVERIFY(codeCompiler.errors().isEmpty());
+    const QByteArray codeTable = QScxmlInternal::BinaryTable::write(
+                QScxmlCompilerPrivate::get(&codeCompiler)->scxmlDocument(), &errorMessage);
+    QVERIFY2(!codeTable.isEmpty(), qPrintable(errorMessage));
+
+    int rejected = 0;
+    for (qsizetype offset = 0; offset + qsizetype(sizeof(qint32)) <= codeTable.size();
+         offset += sizeof(qint32)) {
+        for (qint32 value : { -2, 1000, std::numeric_limits<qint32>::max() }) {
+            damaged = codeTable;
+            std::memcpy(damaged.data() + offset, &value, sizeof(value));
+            QVERIFY(binaryFile.open());
+            binaryFile.resize(0);
+            binaryFile.write(damaged);
+            binaryFile.close();
+            QScopedPointer<QScxmlStateMachine> loaded(
+                        QScxmlStateMachine::fromFile(binaryFile.fileName()));
+            QVERIFY(loaded);
+            if (!loaded->parseErrors().isEmpty())
+                ++rejected;
+        }
+    }
+    QVERIFY(rejected > 0);
+}
+
+struct TogglePayload
+{
+    int count = 0;
+    QString source;
+};
+
+void tst_StateMachine::typedPayload()
+{
+    QScopedPointer<QScxmlStateMachine> stateMachine(
+                QScxmlStateMachine::fromFile(QString(":/tst_statemachine/typedpayload.scxml")));
+    QVERIFY(!stateMachine.isNull());
+    QVERIFY(stateMachine->parseErrors().isEmpty());
+    stateMachine->start();
+    QTRY_VERIFY(stateMachine->isActive("idle"));
+
+    TogglePayload received;
+    stateMachine->connectToEvent("toggle", [&received](const QScxmlEvent &event) {
+        const QVariant data = event.data();
+        QVERIFY(data.metaType() == QMetaType::fromType<TogglePayload>());
+        received = *get_if<TogglePayload>(&data);
+    });
+
+    // A type that QVariant cannot be constructed from is carried as is, not as a map.
+    stateMachine->submitEvent("toggle", TogglePayload{ 42, QStringLiteral("test") });
+    QTRY_VERIFY(stateMachine->isActive("received"));
+    QCOMPARE(received.count, 42);
+    QCOMPARE(received.source, QStringLiteral("test"));
+}
+
+void tst_StateMachine::compiledPayload()
+{
+    // The chart is compiled by qscxmlc. Its <content expr> yields a Reading, which the generated
+    // evaluator stores in the event data as it is, and the data model reads with eventPayload().
+    PayloadMachine stateMachine;
+    PayloadDataModel dataModel;
+    stateMachine.setDataModel(&dataModel);
+    stateMachine.start();
+    QTRY_VERIFY(stateMachine.isActive("idle"));
+
+    stateMachine.submitEvent("measure");
+    QTRY_VERIFY(stateMachine.isActive("received"));
+    QCOMPARE(dataModel.lastReading.value, 21);
+    QCOMPARE(dataModel.lastReading.unit, QString("celsius"));
+}
+
+void tst_StateMachine::ecmaScriptEvent()
+{
+    QScopedPointer<QScxmlStateMachine> stateMachine(
+                QScxmlStateMachine::fromFile(QString(":/tst_statemachine/ecmascriptevent.scxml")));
+    QVERIFY(stateMachine);
+    QCOMPARE(stateMachine->parseErrors().size(), 0);
+    stateMachine->start();
+    QTRY_VERIFY(stateMachine->isActive("idle"));
+
+    QScxmlDataModel *dataModel = stateMachine->dataModel();
+    QVERIFY(dataModel);
+    const auto process = [&stateMachine](const QString &name, const QVariant &data = QVariant()) {
+        stateMachine->submitEvent(name, data);
+        stateMachine->processUntilStable();
+    };
+
+    // _event is created when it is first read, from the event that is being processed then,
+    // also if the events before were never read.
+    process("unread", QVariantMap({ { "a", 0 } }));
+    process("read", QVariantMap({ { "a", 1 } }));
+    QCOMPARE(dataModel->scxmlProperty("name").toString(), QString("read"));
+    QCOMPARE(dataModel->scxmlProperty("data").toMap().value("a").toInt(), 1);
+    QCOMPARE(dataModel->scxmlProperty("same").toBool(), true);
+
+    // Data given as a string is parsed if it is a JSON object or array, and kept otherwise.
+    process("read", QString("{ \"a\": 2 }"));
+    QCOMPARE(dataModel->scxmlProperty("data").toMap().value("a").toInt(), 2);
+    process("read", QString("[ 1, 2, 3 ]"));
+    QCOMPARE(dataModel->scxmlProperty("data").toList().size(), 3);
+    process("read", QString("5"));
+    QCOMPARE(dataModel->scxmlProperty("data").toString(), QString("5"));
+    process("read", QString("plain text"));
+    QCOMPARE(dataModel->scxmlProperty("data").toString(), QString("plain text"));
+
+    // Scripts can assign to _event.data, whether or not it was parsed before.
+    process("overwrite", QString("{ \"a\": 3 }"));
+    QCOMPARE(dataModel->scxmlProperty("data").toInt(), 42);
+    process("overwrite", QVariantMap({ { "a", 3 } }));
+    QCOMPARE(dataModel->scxmlProperty("data").toInt(), 42);
+
+    // An _event object that a script keeps stays valid, and describes its own event.
+    process("save", QString("{ \"a\": 4 }"));
+    process("readSaved", QString("other"));
+    QCOMPARE(dataModel->scxmlProperty("name").toString(), QString("readSaved"));
+    QCOMPARE(dataModel->scxmlProperty("savedName").toString(), QString("save"));
+    QCOMPARE(dataModel->scxmlProperty("data").toMap().value("a").toInt(), 4);
+
+    // _event itself cannot be assigned to.
+    QCOMPARE(dataModel->scxmlProperty("errors").toInt(), 0);
+    process("assignEvent");
+    QCOMPARE(dataModel->scxmlProperty("errors").toInt(), 1);
+    process("read", QString("after"));
+    QCOMPARE(dataModel->scxmlProperty("name").toString(), QString("read"));
+    QCOMPARE(dataModel->scxmlProperty("data").toString(), QString("after"));
+}
+
+void tst_StateMachine::ecmaScriptExpressions()
+{
+    QScopedPointer<QScxmlStateMachine> stateMachine(QScxmlStateMachine::fromFile(
+                QString(":/tst_statemachine/ecmascriptexpressions.scxml")));
+    QVERIFY(stateMachine);
+    QCOMPARE(stateMachine->parseErrors().size(), 0);
+    stateMachine->start();
+    QTRY_VERIFY(stateMachine->isActive("idle"));
+
+    QScxmlDataModel *dataModel = stateMachine->dataModel();
+    QVERIFY(dataModel);
+    const auto process = [&stateMachine](const QString &name) {
+        stateMachine->submitEvent(name);
+        stateMachine->processUntilStable();
+    };
+
+    // Expressions are compiled once, but each evaluation sees the current data.
+    process("check");
+    QCOMPARE(dataModel->scxmlProperty("result").toString(), QString("even 0"));
+    process("increment");
+    process("check");
+    QCOMPARE(dataModel->scxmlProperty("result").toString(), QString("odd 1"));
+    process("increment");
+    process("check");
+    QCOMPARE(dataModel->scxmlProperty("result").toString(), QString("even 2"));
+
+    // An expression that does not compile is reported every time it is evaluated.
+    process("broken");
+    QCOMPARE(dataModel->scxmlProperty("errors").toInt(), 1);
+    process("broken");
+    QCOMPARE(dataModel->scxmlProperty("errors").toInt(), 2);
+    QCOMPARE(dataModel->scxmlProperty("result").toString(), QString("even 2"));
+
+    // In string expressions, "this" is the global object. In value expressions, which are
+    // strict functions, it is undefined.
+    process("evaluateThis");
+    QCOMPARE(dataModel->scxmlProperty("stringThis").toString(),
+             QString("this.EcmaScriptExpressions"));
+    QCOMPARE(dataModel->scxmlProperty("valueThis").toString(), QString("undefined"));
+    QCOMPARE(dataModel->scxmlProperty("errors").toInt(), 2);
+}
+
 QTEST_MAIN(tst_StateMachine)
 
 #include "tst_statemachine.moc"
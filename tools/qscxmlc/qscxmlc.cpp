@@ -1,6 +1,7 @@
 // Copyright (C) 2016 The Qt Company Ltd.
 // SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
 
+#include <QtScxml/private/qscxmlbinarytable_p.h>
 #include <QtScxml/private/qscxmlcompiler_p.h>
 #include <QtScxml/qscxmltabledata.h>
 #include "scxmlcppdumper.h"
@@ -23,7 +24,9 @@ enum {
     CannotOpenOutputHeaderFileError = -5,
     CannotOpenOutputCppFileError = -6,
     ScxmlVerificationError = -7,
-    NoTextCodecError = -8
+    NoTextCodecError = -8,
+    CannotOpenOutputBinaryFileError = -9,
+    BinaryTableError = -10
 };
 
 int write(TranslationUnit *tu)
@@ -64,6 +67,25 @@ int write(TranslationUnit *tu)
     return NoError;
 }
 
+static int writeBinary(DocumentModel::ScxmlDocument *doc, const QString &outFileName)
+{
+    QTextStream errs(stderr, QIODevice::WriteOnly);
+
+    QString errorMessage;
+    const QByteArray table = QScxmlInternal::BinaryTable::write(doc, &errorMessage);
+    if (table.isEmpty()) {
+        errs << QStringLiteral("Error: %1").arg(errorMessage) << Qt::endl;
+        return BinaryTableError;
+    }
+
+    QFile out(outFileName);
+    if (!out.open(QFile::WriteOnly) || out.write(table) != table.size()) {
+        errs << QStringLiteral("Error: cannot write '%1': %2").arg(out.fileName(), out.errorString()) << Qt::endl;
+        return CannotOpenOutputBinaryFileError;
+    }
+    return NoError;
+}
+
 static void collectAllDocuments(DocumentModel::ScxmlDocument *doc,
                                 QList<DocumentModel::ScxmlDocument *> *docs)
 {
@@ -99,6 +121,10 @@ int run(const QStringList &arguments)
                        QCoreApplication::translate("main", "name"));
     QCommandLineOption optionStateMethods(QLatin1String("statemethods"),
                        QCoreApplication::translate("main", "Generate read and notify methods for states"));
+    QCommandLineOption optionBinary(QLatin1String("binary"),
+                       QCoreApplication::translate("main", "Generate a binary state table <name>.scxmlbin, "
+                                                   "to be loaded with QScxmlStateMachine::fromFile(), "
+                                                   "instead of C++ code."));
 
     cmdParser.addPositionalArgument(QLatin1String("input"),
                        QCoreApplication::translate("main", "Input SCXML file."));
@@ -108,6 +134,7 @@ int run(const QStringList &arguments)
     cmdParser.addOption(optionOutputSourceName);
     cmdParser.addOption(optionClassName);
     cmdParser.addOption(optionStateMethods);
+    cmdParser.addOption(optionBinary);
 
     cmdParser.process(arguments);
 
@@ -170,6 +197,9 @@ int run(const QStringList &arguments)
         return ScxmlVerificationError;
     }
 
+    if (cmdParser.isSet(optionBinary))
+        return writeBinary(mainDoc, outFileName + QLatin1String(".scxmlbin"));
+
     if (mainClassName.isEmpty())
         mainClassName = mainDoc->root->name;
     if (mainClassName.isEmpty()) {
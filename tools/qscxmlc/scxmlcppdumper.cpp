@@ -311,7 +311,7 @@ void generateCppDataModelEvaluators(const GeneratedTableData::DataModelInfo &inf
         for (auto it = info.variantEvaluators.constBegin(), eit = info.variantEvaluators.constEnd();
              it != eit; ++it) {
             variantEvals += QStringLiteral("    case %1:\n").arg(it.key());
-            variantEvals += QStringLiteral("        return [this]()->QVariant{ return %1; }();\n")
+            variantEvals += QStringLiteral("        return scxmlVariant([this]{ return %1; }());\n")
                     .arg(it.value());
         }
         variantEvals += switchEnd;